@@ -0,0 +1,637 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <algorithm>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <optional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+#include "compress.h"
+#include "error.h"
+#include "log.h"
+#include "str.h"
+
+
+static bool write_all(const int fd, const std::string & data)
+{
+	const char *p   = data.c_str();
+	size_t      len = data.size();
+
+	while(len > 0) {
+		ssize_t rc = write(fd, p, len);
+
+		if (rc == -1 && errno == EINTR)
+			continue;
+
+		if (rc <= 0)
+			return false;
+
+		p   += rc;
+		len -= rc;
+	}
+
+	return true;
+}
+
+static const uint8_t *map_file(const std::string & file, size_t *const size)
+{
+	int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return nullptr;
+
+	struct stat st { };
+
+	const uint8_t *p = nullptr;
+
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+		if (m != MAP_FAILED) {
+			p     = reinterpret_cast<const uint8_t *>(m);
+			*size = st.st_size;
+		}
+	}
+
+	close(fd);
+
+	return p;
+}
+
+archive_winner_t archive_winner(const std::string & result)
+{
+	if (result.empty())
+		return AW_UNKNOWN;
+
+	char c = tolower(result.at(0));
+
+	if (c == 'b')
+		return AW_BLACK;
+
+	if (c == 'w')
+		return AW_WHITE;
+
+	if (c == '0' || c == 'd' || c == 'j')  // "0", "Draw", "Jigo"
+		return AW_DRAW;
+
+	return AW_UNKNOWN;
+}
+
+std::optional<uint16_t> archive_encode_move(const std::string & sgf_move)
+{
+	if (sgf_move.size() < 3 || (sgf_move.at(0) != 'B' && sgf_move.at(0) != 'W') || sgf_move.at(1) != '[' || sgf_move.back() != ']')
+		return { };
+
+	uint16_t color = sgf_move.at(0) == 'W' ? ARCHIVE_MOVE_WHITE : 0;
+
+	if (sgf_move.size() == 3)  // "B[]"
+		return color | ARCHIVE_MOVE_PASS;
+
+	if (sgf_move.size() != 5)
+		return { };
+
+	int x = sgf_move.at(2) - 'a';
+	int y = sgf_move.at(3) - 'a';
+
+	if (x < 0 || x >= 0x7f || y < 0 || y >= 0x7f)
+		return { };
+
+	return color | (y << 8) | x;
+}
+
+std::string archive_decode_move(const uint16_t move)
+{
+	char color = move & ARCHIVE_MOVE_WHITE ? 'W' : 'B';
+
+	if ((move & ~ARCHIVE_MOVE_WHITE) == ARCHIVE_MOVE_PASS)
+		return myformat("%c[]", color);
+
+	return myformat("%c[%c%c]", color, 'a' + (move & 0x7f), 'a' + ((move >> 8) & 0x7f));
+}
+
+// the same layout as the sgf files written by badank
+std::string archive_to_sgf(const archive_record_t & r)
+{
+	const archive_game_t & h = r.header;
+
+	std::string result(h.result, strnlen(h.result, sizeof h.result));
+
+	time_t t = h.start_t;
+	tm tm { };
+	localtime_r(&t, &tm);
+
+	std::string out = myformat("(;AP[Badank]DT[%04d-%02d-%02d]GM[1]KM[%f]SZ[%d]PW[%s]\nPB[%s]\nRE[%s]\nC[%d> ]RU[Tromp/Taylor]\n(", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, h.komi, h.dim, r.white.c_str(), r.black.c_str(), str_toupper(result).c_str(), h.nr);
+
+	for(auto & m : r.moves)
+		out += ";" + archive_decode_move(m);
+
+	if (h.rr != 0)  // RR_OK
+		out += myformat(";C[%s]", str_tolower(result).c_str());
+
+	out += myformat(";C[Initial %d black and %d white stones were placed randomly by Badank]", h.n_random_stones, h.n_random_stones);
+
+	out += ")\n)\n\n";
+
+	return out;
+}
+
+ArchiveWriter::ArchiveWriter(const std::string & file) : file(file)
+{
+	ArchiveReader r(file);
+
+	fd = open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1)
+		error_exit(true, "Cannot open archive \"%s\"", file.c_str());
+
+	if (r.is_valid()) {
+		for(size_t i=0; i<r.get_player_names().size(); i++)
+			players.insert({ r.get_player_names().at(i), uint16_t(i) });
+
+		// an interrupted write leaves an incomplete record
+		if (ftruncate(fd, r.get_valid_end()) == -1)
+			error_exit(true, "Cannot truncate archive \"%s\"", file.c_str());
+	}
+	else {
+		struct stat st { };
+
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+			error_exit(false, "\"%s\" is not a badank archive", file.c_str());
+
+		archive_file_header_t fh { };
+		memcpy(fh.magic, ARCHIVE_MAGIC, sizeof fh.magic);
+		fh.version = ARCHIVE_VERSION;
+
+		if (write_all(fd, std::string(reinterpret_cast<const char *>(&fh), sizeof fh)) == false)
+			error_exit(true, "Cannot write to archive \"%s\"", file.c_str());
+	}
+}
+
+ArchiveWriter::~ArchiveWriter()
+{
+	flush();
+
+	fsync(fd);
+	close(fd);
+
+	if (archive_build_index(file) == false)
+		dolog(error, "Cannot create the index of archive \"%s\"", file.c_str());
+}
+
+uint16_t ArchiveWriter::player_id(const std::string & name)
+{
+	auto it = players.find(name);
+
+	if (it != players.end())
+		return it->second;
+
+	uint16_t id  = players.size();
+	uint16_t len = std::min(name.size(), size_t(65535));
+
+	players.insert({ name, id });
+
+	pending += 'P';
+	pending.append(reinterpret_cast<const char *>(&id), sizeof id);
+	pending.append(reinterpret_cast<const char *>(&len), sizeof len);
+	pending.append(name, 0, len);
+
+	return id;
+}
+
+void ArchiveWriter::add(const archive_record_t & r)
+{
+	archive_game_t h = r.header;
+
+	h.black   = player_id(r.black);
+	h.white   = player_id(r.white);
+	h.n_moves = r.moves.size();
+
+	pending += 'G';
+	pending.append(reinterpret_cast<const char *>(&h), sizeof h);
+	pending.append(reinterpret_cast<const char *>(r.moves.data()), r.moves.size() * sizeof(uint16_t));
+}
+
+bool ArchiveWriter::flush()
+{
+	bool ok = write_all(fd, pending);
+
+	if (!ok)
+		dolog(error, "Cannot write to archive \"%s\": %s", file.c_str(), strerror(errno));
+
+	pending.clear();
+
+	return ok;
+}
+
+ArchiveReader::ArchiveReader(const std::string & file) : file(file)
+{
+	archive = map_file(file, &size);
+
+	if (archive == nullptr)
+		return;
+
+	if (size < sizeof(archive_file_header_t) || memcmp(archive, ARCHIVE_MAGIC, 4) != 0) {
+		munmap(const_cast<uint8_t *>(archive), size);
+		archive = nullptr;
+
+		return;
+	}
+
+	valid_end = sizeof(archive_file_header_t);
+
+	for(;;) {
+		auto next = next_record(valid_end);
+
+		if (next.has_value() == false)
+			break;
+
+		if (archive[valid_end] == 'P') {
+			uint16_t id  = 0;
+			uint16_t len = 0;
+			memcpy(&id,  &archive[valid_end + 1], sizeof id);
+			memcpy(&len, &archive[valid_end + 3], sizeof len);
+
+			if (id >= player_names.size())
+				player_names.resize(id + 1);
+
+			player_names.at(id).assign(reinterpret_cast<const char *>(&archive[valid_end + 5]), len);
+		}
+
+		valid_end = next.value();
+	}
+
+	index = map_file(file + ".idx", &index_size);
+
+	if (index && index_size >= sizeof(archive_index_header_t)) {
+		auto h = reinterpret_cast<const archive_index_header_t *>(index);
+
+		// games that were added after the index was written are not in it
+		if (memcmp(h->magic, INDEX_MAGIC, 4) == 0 && h->version == ARCHIVE_VERSION && h->archive_size == valid_end)
+			ih = h;
+	}
+}
+
+ArchiveReader::~ArchiveReader()
+{
+	if (archive)
+		munmap(const_cast<uint8_t *>(archive), size);
+
+	if (index)
+		munmap(const_cast<uint8_t *>(index), index_size);
+}
+
+// nothing when the record at 'offset' is incomplete or invalid
+std::optional<uint64_t> ArchiveReader::next_record(const uint64_t offset) const
+{
+	if (offset >= size)
+		return { };
+
+	if (archive[offset] == 'P' && offset + 5 <= size) {
+		uint16_t len = 0;
+		memcpy(&len, &archive[offset + 3], sizeof len);
+
+		if (offset + 5 + len <= size)
+			return offset + 5 + len;
+	}
+	else if (archive[offset] == 'G' && offset + 1 + sizeof(archive_game_t) <= size) {
+		archive_game_t h;
+		memcpy(&h, &archive[offset + 1], sizeof h);
+
+		uint64_t end = offset + 1 + sizeof h + uint64_t(h.n_moves) * sizeof(uint16_t);
+
+		if (end <= size)
+			return end;
+	}
+
+	return { };
+}
+
+std::optional<archive_record_t> ArchiveReader::get_at(const uint64_t offset) const
+{
+	if (offset >= valid_end || archive[offset] != 'G')
+		return { };
+
+	archive_record_t r;
+	memcpy(&r.header, &archive[offset + 1], sizeof r.header);
+
+	if (r.header.black < player_names.size())
+		r.black = player_names.at(r.header.black);
+
+	if (r.header.white < player_names.size())
+		r.white = player_names.at(r.header.white);
+
+	r.moves.resize(r.header.n_moves);
+	memcpy(r.moves.data(), &archive[offset + 1 + sizeof r.header], r.header.n_moves * sizeof(uint16_t));
+
+	return r;
+}
+
+void ArchiveReader::for_each(const std::function<void(const uint64_t offset, const archive_record_t & r)> & cb) const
+{
+	uint64_t offset = sizeof(archive_file_header_t);
+
+	while(offset < valid_end) {
+		if (archive[offset] == 'G')
+			cb(offset, get_at(offset).value());
+
+		offset = next_record(offset).value();
+	}
+}
+
+std::optional<archive_record_t> ArchiveReader::get_by_nr(const uint32_t nr) const
+{
+	if (ih == nullptr || nr >= ih->n_nrs)
+		return { };
+
+	uint64_t offset = 0;
+	memcpy(&offset, &index[ih->by_nr + nr * sizeof(uint64_t)], sizeof offset);
+
+	if (offset == ~uint64_t(0))
+		return { };
+
+	return get_at(offset);
+}
+
+static std::vector<uint64_t> get_list(const uint8_t *const index, const archive_index_header_t *const ih, const archive_index_list_t & l)
+{
+	std::vector<uint64_t> out(l.count);
+
+	memcpy(out.data(), &index[ih->lists + l.first * sizeof(uint64_t)], l.count * sizeof(uint64_t));
+
+	return out;
+}
+
+std::vector<uint64_t> ArchiveReader::get_by_player(const std::string & name) const
+{
+	if (ih == nullptr)
+		return { };
+
+	for(uint32_t i=0; i<ih->n_players; i++) {
+		archive_index_player_t p;
+		memcpy(&p, &index[ih->players + i * sizeof p], sizeof p);
+
+		if (name == std::string(reinterpret_cast<const char *>(&index[ih->names + p.name]), p.name_len))
+			return get_list(index, ih, p.games);
+	}
+
+	return { };
+}
+
+std::vector<uint64_t> ArchiveReader::get_by_result(const archive_winner_t w) const
+{
+	if (ih == nullptr || w >= AW_N)
+		return { };
+
+	archive_index_list_t l;
+	memcpy(&l, &index[ih->results + w * sizeof l], sizeof l);
+
+	return get_list(index, ih, l);
+}
+
+bool archive_build_index(const std::string & file)
+{
+	ArchiveReader r(file);
+
+	if (r.is_valid() == false)
+		return false;
+
+	const auto & names = r.get_player_names();
+
+	typedef std::vector<std::pair<uint32_t, uint64_t> > list_t;  // nr, offset
+
+	std::vector<uint64_t> by_nr;
+	std::vector<list_t>   per_player(names.size());
+	std::vector<list_t>   per_result(AW_N);
+	uint32_t              n_games = 0;
+
+	r.for_each([&](const uint64_t offset, const archive_record_t & g) {
+			const archive_game_t & h = g.header;
+
+			if (h.nr >= by_nr.size())
+				by_nr.resize(h.nr + 1, ~uint64_t(0));
+
+			by_nr.at(h.nr) = offset;
+
+			if (h.black < per_player.size())
+				per_player.at(h.black).push_back({ h.nr, offset });
+
+			if (h.white < per_player.size() && h.white != h.black)
+				per_player.at(h.white).push_back({ h.nr, offset });
+
+			per_result.at(h.winner < AW_N ? h.winner : AW_UNKNOWN).push_back({ h.nr, offset });
+
+			n_games++;
+		});
+
+	std::vector<archive_index_player_t> players;
+	std::vector<archive_index_list_t>   results;
+	std::vector<uint64_t>               lists;
+	std::string                         name_data;
+
+	auto add_list = [&lists](list_t & l) {
+		std::stable_sort(l.begin(), l.end(), [](const auto & a, const auto & b) { return a.first < b.first; });
+
+		archive_index_list_t out { lists.size(), uint32_t(l.size()) };
+
+		for(auto & e : l)
+			lists.push_back(e.second);
+
+		return out;
+	};
+
+	for(size_t i=0; i<names.size(); i++) {
+		players.push_back({ add_list(per_player.at(i)), uint32_t(name_data.size()), uint16_t(names.at(i).size()), 0 });
+
+		name_data += names.at(i);
+	}
+
+	for(auto & l : per_result)
+		results.push_back(add_list(l));
+
+	archive_index_header_t ih { };
+	memcpy(ih.magic, INDEX_MAGIC, sizeof ih.magic);
+	ih.version      = ARCHIVE_VERSION;
+	ih.archive_size = r.get_valid_end();
+	ih.n_games      = n_games;
+	ih.n_nrs        = by_nr.size();
+	ih.n_players    = players.size();
+	ih.by_nr        = sizeof ih;
+	ih.players      = ih.by_nr   + by_nr.size()   * sizeof(uint64_t);
+	ih.results      = ih.players + players.size() * sizeof(archive_index_player_t);
+	ih.lists        = ih.results + results.size() * sizeof(archive_index_list_t);
+	ih.names        = ih.lists   + lists.size()   * sizeof(uint64_t);
+
+	std::string out(reinterpret_cast<const char *>(&ih), sizeof ih);
+	out.append(reinterpret_cast<const char *>(by_nr.data()),   by_nr.size()   * sizeof(uint64_t));
+	out.append(reinterpret_cast<const char *>(players.data()), players.size() * sizeof(archive_index_player_t));
+	out.append(reinterpret_cast<const char *>(results.data()), results.size() * sizeof(archive_index_list_t));
+	out.append(reinterpret_cast<const char *>(lists.data()),   lists.size()   * sizeof(uint64_t));
+	out += name_data;
+
+	// readers never see a partial index
+	std::string temp = file + ".idx.tmp";
+
+	int fd = open(temp.c_str(), O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return false;
+
+	bool ok = write_all(fd, out) && fsync(fd) == 0;
+
+	close(fd);
+
+	if (ok)
+		ok = rename(temp.c_str(), (file + ".idx").c_str()) == 0;
+	else
+		unlink(temp.c_str());
+
+	return ok;
+}
+
+// the properties that badank writes; others are ignored
+static void process_property(const std::string & key, const std::string & value, archive_record_t *const r, bool *const has_nr)
+{
+	archive_game_t & h = r->header;
+
+	if (key == "B" || key == "W") {
+		auto m = archive_encode_move(key + "[" + value + "]");
+
+		if (m.has_value())
+			r->moves.push_back(m.value());
+	}
+	else if (key == "PB")
+		r->black = value;
+	else if (key == "PW")
+		r->white = value;
+	else if (key == "RE") {
+		strncpy(h.result, value.c_str(), sizeof h.result - 1);
+		h.winner = archive_winner(value);
+	}
+	else if (key == "KM")
+		h.komi = atof(value.c_str());
+	else if (key == "SZ")
+		h.dim = atoi(value.c_str());
+	else if (key == "DT") {
+		tm tm { };
+
+		if (sscanf(value.c_str(), "%d-%d-%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday) == 3) {
+			tm.tm_year -= 1900;
+			tm.tm_mon  -= 1;
+			tm.tm_isdst = -1;
+
+			h.start_t = mktime(&tm);
+		}
+	}
+	else if (key == "C") {
+		int n = 0;
+
+		if (*has_nr == false && r->moves.empty() && sscanf(value.c_str(), "%d> ", &n) == 1) {
+			h.nr    = n;
+			*has_nr = true;
+		}
+		else if (sscanf(value.c_str(), "Initial %d black", &n) == 1)
+			h.n_random_stones = n;
+		else if (r->moves.empty() == false && str_toupper(value) == str_toupper(std::string(h.result, strnlen(h.result, sizeof h.result))))
+			h.rr = 1;  // RR_ERROR: the sgf does not tell an error from a timeout
+	}
+}
+
+bool archive_from_sgf(const std::string & sgf_file, ArchiveWriter *const w, int *const n_games)
+{
+	archive_record_t r { };
+	bool             has_nr      = false;
+	int              depth       = 0;
+	bool             get_key     = true;
+	bool             escape      = false;
+	bool             after_value = false;
+	std::string      key;
+	std::string      value;
+
+	*n_games = 0;
+
+	auto reset = [&]() {
+		r                = archive_record_t { };
+		r.header.dim     = 19;
+		r.header.opening = -1;
+		has_nr           = false;
+	};
+
+	reset();
+
+	// may be compressed; it is read in parts, the file can be big
+	auto process = [&](const char *const data, const size_t n) {
+		for(size_t i=0; i<n; i++) {
+			int c = (unsigned char)data[i];
+
+			if (get_key == false) {
+				if (escape) {
+					value += char(c);
+					escape = false;
+				}
+				else if (c == '\\')
+					escape = true;
+				else if (c == ']') {
+					process_property(key, value, &r, &has_nr);
+
+					value.clear();
+
+					get_key     = true;
+					after_value = true;
+				}
+				else {
+					value += char(c);
+				}
+			}
+			else if (c == '(') {
+				depth++;
+				key.clear();
+			}
+			else if (c == ')') {
+				if (--depth == 0) {
+					if (has_nr == false)
+						r.header.nr = *n_games;
+
+					w->add(r);
+
+					(*n_games)++;
+
+					reset();
+				}
+
+				key.clear();
+			}
+			else if (c == ';') {
+				key.clear();
+			}
+			else if (c == '[') {
+				// "AB[aa][bb]": the key is repeated
+				get_key = false;
+			}
+			else if (isupper(c)) {
+				// a new key after the value(s) of the previous one
+				if (after_value)
+					key.clear();
+
+				after_value = false;
+
+				key += char(c);
+			}
+			else if (isspace(c) == false) {
+				key.clear();
+			}
+		}
+	};
+
+	if (read_file(sgf_file, process) == false)
+		return false;
+
+	return depth == 0;
+}
@@ -0,0 +1,161 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+// Binary game archive. All numbers are in host byte order.
+//
+// archive file: archive_file_header_t, then records. A record starts with
+// one byte: 'P' introduces a player (uint16_t id, uint16_t length, name),
+// 'G' is a game (archive_game_t followed by 'n_moves' moves).
+//
+// index file (archive file + ".idx"), for mmap(): archive_index_header_t,
+// then the sections that it points to.
+
+#define ARCHIVE_MAGIC   "BDKA"
+#define INDEX_MAGIC     "BDKI"
+#define ARCHIVE_VERSION 1
+
+// a move: x in the low byte, y in bits 8...14, bit 15 is set for white
+#define ARCHIVE_MOVE_PASS  0x7f7f
+#define ARCHIVE_MOVE_WHITE 0x8000
+
+typedef enum { AW_UNKNOWN = 0, AW_BLACK, AW_WHITE, AW_DRAW, AW_N } archive_winner_t;
+
+typedef struct __attribute__((packed)) {
+	char     magic[4];
+	uint32_t version;
+} archive_file_header_t;
+
+typedef struct __attribute__((packed)) {
+	uint32_t nr;
+	uint16_t black, white;     // player ids
+	uint8_t  dim;
+	uint8_t  winner;           // archive_winner_t
+	uint8_t  rr;               // run_result_t
+	uint8_t  n_random_stones;
+	char     result[16];       // as reported, e.g. "B+Resign"; nul-padded
+	float    komi;
+	int32_t  opening;          // index in the sgf book, -1 for random stones
+	int64_t  start_t;          // unix time
+	uint64_t took;             // nanoseconds
+	uint64_t time_used[2];     // nanoseconds charged to black and white
+	uint32_t n_moves;
+} archive_game_t;
+
+typedef struct __attribute__((packed)) {
+	char     magic[4];
+	uint32_t version;
+	uint64_t archive_size;     // the index is stale when the archive is larger
+	uint32_t n_games;
+	uint32_t n_nrs;            // entries in 'by_nr': highest game number + 1
+	uint32_t n_players;
+	uint32_t pad;
+	uint64_t by_nr;            // uint64_t[n_nrs]: offset of the game, or ~0
+	uint64_t players;          // archive_index_player_t[n_players], by id
+	uint64_t results;          // archive_index_list_t[AW_N], by winner
+	uint64_t lists;            // uint64_t: offsets of games, per list by number
+	uint64_t names;            // player names
+} archive_index_header_t;
+
+typedef struct __attribute__((packed)) {
+	uint64_t first;            // in 'lists'
+	uint32_t count;
+} archive_index_list_t;
+
+typedef struct __attribute__((packed)) {
+	archive_index_list_t games;
+	uint32_t             name;      // offset in 'names'
+	uint16_t             name_len;
+	uint16_t             pad;
+} archive_index_player_t;
+
+// one game before the names are replaced by player ids
+typedef struct {
+	archive_game_t        header;
+	std::string           black, white;
+	std::vector<uint16_t> moves;
+} archive_record_t;
+
+archive_winner_t archive_winner(const std::string & result);
+// "B[aa]", "W[]" and such; nothing when not a move
+std::optional<uint16_t> archive_encode_move(const std::string & sgf_move);
+std::string archive_decode_move(const uint16_t move);
+
+std::string archive_to_sgf(const archive_record_t & r);
+
+// appends to an archive; a batch of games is written with one write()
+class ArchiveWriter
+{
+private:
+	const std::string file;
+	int               fd { -1 };
+
+	std::map<std::string, uint16_t> players;
+	std::string                     pending;
+
+	uint16_t player_id(const std::string & name);
+
+public:
+	// terminates the program when the file cannot be used
+	ArchiveWriter(const std::string & file);
+	// also writes the index
+	~ArchiveWriter();
+
+	void add(const archive_record_t & r);
+	bool flush();
+};
+
+// reads an archive (and its index) through mmap()
+class ArchiveReader
+{
+private:
+	const std::string file;
+
+	const uint8_t *archive  { nullptr };
+	size_t         size     { 0 };
+	const uint8_t *index    { nullptr };
+	size_t         index_size { 0 };
+
+	const archive_index_header_t *ih { nullptr };
+
+	std::vector<std::string> player_names;  // from the archive, by id
+
+	uint64_t valid_end { 0 };  // after the last complete record
+
+	std::optional<uint64_t> next_record(const uint64_t offset) const;
+
+public:
+	ArchiveReader(const std::string & file);
+	~ArchiveReader();
+
+	// false when the archive cannot be read
+	bool is_valid() const { return archive != nullptr; }
+	// false when there is no index or it is older than the archive
+	bool has_index() const { return ih != nullptr; }
+
+	// calls 'cb' for each game, in the order of the archive
+	void for_each(const std::function<void(const uint64_t offset, const archive_record_t & r)> & cb) const;
+
+	// requires the index
+	std::optional<archive_record_t> get_by_nr(const uint32_t nr) const;
+	std::vector<uint64_t>           get_by_player(const std::string & name) const;
+	std::vector<uint64_t>           get_by_result(const archive_winner_t w) const;
+
+	std::optional<archive_record_t> get_at(const uint64_t offset) const;
+	const std::vector<std::string> & get_player_names() const { return player_names; }
+	uint64_t get_valid_end() const { return valid_end; }
+};
+
+// (re-)creates the index of an archive
+bool archive_build_index(const std::string & file);
+// converts a file with the games in sgf as written by badank
+bool archive_from_sgf(const std::string & sgf_file, ArchiveWriter *const w, int *const n_games);
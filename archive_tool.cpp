@@ -0,0 +1,200 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <algorithm>
+#include <inttypes.h>
+#include <optional>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#include "archive.h"
+
+
+static void help()
+{
+	printf("badank-archive index <archive>\n");
+	printf("\t(re-)creates the index of the archive\n");
+	printf("badank-archive from-sgf <sgf-file> <archive>\n");
+	printf("\tadds the games in an sgf file (as written by badank) to the archive\n");
+	printf("badank-archive to-sgf <archive> [nr]\n");
+	printf("\twrites all games, or game 'nr', in sgf\n");
+	printf("badank-archive query <archive> [--nr x] [--player name] [--result black|white|draw|unknown]\n");
+	printf("\tlists the games (all of them when no selection is given)\n");
+}
+
+static void print_game(const archive_record_t & r)
+{
+	const archive_game_t & h = r.header;
+
+	printf("%u\t%s\t%s\t%.*s\t%u\t%.3f\n", h.nr, r.black.c_str(), r.white.c_str(), int(strnlen(h.result, sizeof h.result)), h.result, h.n_moves, h.took / 1e9);
+}
+
+static int query(const ArchiveReader & ar, const std::optional<uint32_t> nr, const std::optional<std::string> & player, const std::optional<archive_winner_t> winner)
+{
+	if (!nr.has_value() && !player.has_value() && !winner.has_value()) {
+		ar.for_each([](const uint64_t offset, const archive_record_t & r) { print_game(r); });
+
+		return 0;
+	}
+
+	if (ar.has_index() == false) {
+		fprintf(stderr, "The index is missing or out of date, run \"badank-archive index\" first\n");
+
+		return 1;
+	}
+
+	if (nr.has_value()) {
+		auto r = ar.get_by_nr(nr.value());
+
+		if (r.has_value() && (!player.has_value() || r.value().black == player.value() || r.value().white == player.value()) && (!winner.has_value() || r.value().header.winner == winner.value()))
+			print_game(r.value());
+
+		return 0;
+	}
+
+	// both lists are ordered by game number
+	std::vector<uint64_t> offsets = player.has_value() ? ar.get_by_player(player.value()) : ar.get_by_result(winner.value());
+
+	if (player.has_value() && winner.has_value()) {
+		auto by_result = ar.get_by_result(winner.value());
+
+		std::set<uint64_t> allowed(by_result.begin(), by_result.end());
+
+		offsets.erase(std::remove_if(offsets.begin(), offsets.end(), [&allowed](const uint64_t o) { return allowed.find(o) == allowed.end(); }), offsets.end());
+	}
+
+	for(auto & o : offsets)
+		print_game(ar.get_at(o).value());
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		help();
+
+		return 1;
+	}
+
+	std::string cmd = argv[1];
+
+	if (cmd != "index" && cmd != "from-sgf" && cmd != "to-sgf" && cmd != "query") {
+		help();
+
+		return 1;
+	}
+
+	if (cmd == "index") {
+		if (archive_build_index(argv[2]) == false) {
+			fprintf(stderr, "Cannot create the index of \"%s\"\n", argv[2]);
+
+			return 1;
+		}
+
+		return 0;
+	}
+
+	if (cmd == "from-sgf" && argc == 4) {
+		int  n_games = 0;
+		bool ok      = false;
+
+		{
+			ArchiveWriter aw(argv[3]);
+
+			ok = archive_from_sgf(argv[2], &aw, &n_games);
+		}
+
+		printf("%d games added\n", n_games);
+
+		if (!ok)
+			fprintf(stderr, "\"%s\" could not be read (completely)\n", argv[2]);
+
+		return ok ? 0 : 1;
+	}
+
+	ArchiveReader ar(argv[2]);
+
+	if (ar.is_valid() == false) {
+		fprintf(stderr, "\"%s\" is not a badank archive\n", argv[2]);
+
+		return 1;
+	}
+
+	if (cmd == "to-sgf" && argc <= 4) {
+		if (argc == 4) {
+			if (ar.has_index() == false) {
+				fprintf(stderr, "The index is missing or out of date, run \"badank-archive index\" first\n");
+
+				return 1;
+			}
+
+			auto r = ar.get_by_nr(atoi(argv[3]));
+
+			if (r.has_value() == false) {
+				fprintf(stderr, "Game %s is not in the archive\n", argv[3]);
+
+				return 1;
+			}
+
+			printf("%s", archive_to_sgf(r.value()).c_str());
+		}
+		else {
+			ar.for_each([](const uint64_t offset, const archive_record_t & r) { printf("%s", archive_to_sgf(r).c_str()); });
+		}
+
+		return 0;
+	}
+
+	if (cmd == "query") {
+		std::optional<uint32_t>         nr;
+		std::optional<std::string>      player;
+		std::optional<archive_winner_t> winner;
+
+		if ((argc - 3) % 2) {
+			help();
+
+			return 1;
+		}
+
+		for(int i=3; i<argc; i += 2) {
+			std::string key   = argv[i];
+			std::string value = argv[i + 1];
+
+			if (key == "--nr")
+				nr = atoi(value.c_str());
+			else if (key == "--player")
+				player = value;
+			else if (key == "--result") {
+				if (value == "black")
+					winner = AW_BLACK;
+				else if (value == "white")
+					winner = AW_WHITE;
+				else if (value == "draw")
+					winner = AW_DRAW;
+				else if (value == "unknown")
+					winner = AW_UNKNOWN;
+				else {
+					help();
+
+					return 1;
+				}
+			}
+			else {
+				help();
+
+				return 1;
+			}
+		}
+
+		return query(ar, nr, player, winner);
+	}
+
+	help();
+
+	return 1;
+}
@@ -0,0 +1,62 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string>
+
+#include "board.h"
+#include "color.h"
+#include "str.h"
+
+
+bool GoBoard::play(const color_t c, const std::string & vertex)
+{
+	std::string v = str_tolower(vertex);
+
+	if (v == "pass")
+		return true;
+
+	if (v.size() < 2 || v.at(0) < 'a' || v.at(0) > 'z' || v.at(0) == 'i' || !isdigit(v.at(1)))
+		return false;
+
+	int x = v.at(0) - 'a';
+	if (v.at(0) > 'i')  // there's no 'i' in GTP coordinates
+		x--;
+
+	int y = atoi(v.substr(1).c_str()) - 1;
+
+	return play(c, x, y);
+}
+
+std::string GoBoard::result(const double komi) const
+{
+	double s = score() - komi;
+
+	if (s > 0)
+		return myformat("B+%g", s);
+
+	if (s < 0)
+		return myformat("W+%g", -s);
+
+	return "0";
+}
+
+bool is_board_size_supported(const int dim)
+{
+	return dim == 9 || dim == 13 || dim == 19;
+}
+
+GoBoard *make_board(const int dim)
+{
+	if (dim == 9)
+		return new Board<9>();
+
+	if (dim == 13)
+		return new Board<13>();
+
+	if (dim == 19)
+		return new Board<19>();
+
+	return nullptr;
+}
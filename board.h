@@ -0,0 +1,253 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <array>
+#include <random>
+#include <stdint.h>
+#include <string>
+#include <unordered_set>
+
+#include "color.h"
+
+
+// rules engine: validates moves and scores the final position so that no
+// external scorer process is required
+class GoBoard
+{
+public:
+	virtual ~GoBoard() { }
+
+	virtual int  getdim() const = 0;
+
+	virtual void clear() = 0;
+
+	// returns false for an illegal move (occupied, suicide or a positional superko violation)
+	virtual bool play(const color_t c, const int x, const int y) = 0;
+
+	// Tromp/Taylor area score: black minus white, without komi
+	virtual int  score() const = 0;
+
+	// vertex in GTP notation, e.g. "D4" or "pass"
+	bool play(const color_t c, const std::string & vertex);
+
+	// "B+3.5", "W+0.5" or "0"
+	std::string result(const double komi) const;
+};
+
+bool is_board_size_supported(const int dim);
+
+// returns nullptr for board sizes without a specialisation
+GoBoard *make_board(const int dim);
+
+template <int dim>
+class Board final : public GoBoard
+{
+private:
+	static constexpr int stride  = dim + 2;  // with a border around it
+	static constexpr int n_cells = stride * stride;
+
+	enum : uint8_t { E_EMPTY = 0, E_BLACK = 1, E_WHITE = 2, E_BORDER = 3 };
+
+	std::array<uint8_t, n_cells> cells;
+	uint64_t                     hash { 0 };
+	std::unordered_set<uint64_t> history;
+
+	mutable std::array<uint32_t, n_cells> mark { };
+	mutable uint32_t                      mark_gen { 0 };
+	mutable std::array<int, n_cells>      stack;
+
+	static const std::array<uint64_t, n_cells * 2> & zobrist()
+	{
+		static const std::array<uint64_t, n_cells * 2> table = [] {
+			std::array<uint64_t, n_cells * 2> t;
+			std::mt19937_64 gen(dim);  // fixed seed, only needs to be unique
+
+			for(auto & v : t)
+				v = gen();
+
+			return t;
+		}();
+
+		return table;
+	}
+
+	void set(const int pos, const uint8_t what)
+	{
+		if (cells[pos] != E_EMPTY)
+			hash ^= zobrist()[pos * 2 + cells[pos] - 1];
+
+		cells[pos] = what;
+
+		if (what != E_EMPTY)
+			hash ^= zobrist()[pos * 2 + what - 1];
+	}
+
+	uint32_t new_mark() const
+	{
+		if (++mark_gen == 0) {
+			mark.fill(0);
+			mark_gen = 1;
+		}
+
+		return mark_gen;
+	}
+
+	bool has_liberty(const int start) const
+	{
+		const uint8_t  color = cells[start];
+		const uint32_t m     = new_mark();
+		int            sp    = 0;
+
+		stack[sp++] = start;
+		mark[start] = m;
+
+		while(sp > 0) {
+			const int pos = stack[--sp];
+
+			for(const int n : { pos - 1, pos + 1, pos - stride, pos + stride }) {
+				if (cells[n] == E_EMPTY)
+					return true;
+
+				if (cells[n] == color && mark[n] != m) {
+					mark[n] = m;
+					stack[sp++] = n;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	void remove_group(const int start)
+	{
+		const uint8_t color = cells[start];
+		int           sp    = 0;
+
+		stack[sp++] = start;
+		set(start, E_EMPTY);
+
+		while(sp > 0) {
+			const int pos = stack[--sp];
+
+			for(const int n : { pos - 1, pos + 1, pos - stride, pos + stride }) {
+				if (cells[n] == color) {
+					set(n, E_EMPTY);
+					stack[sp++] = n;
+				}
+			}
+		}
+	}
+
+public:
+	Board()
+	{
+		clear();
+	}
+
+	int getdim() const override
+	{
+		return dim;
+	}
+
+	void clear() override
+	{
+		cells.fill(E_BORDER);
+
+		for(int y=0; y<dim; y++) {
+			for(int x=0; x<dim; x++)
+				cells[(y + 1) * stride + x + 1] = E_EMPTY;
+		}
+
+		hash = 0;
+
+		history.clear();
+		history.insert(hash);
+	}
+
+	bool play(const color_t c, const int x, const int y) override
+	{
+		if (x < 0 || y < 0 || x >= dim || y >= dim)
+			return false;
+
+		const int pos = (y + 1) * stride + x + 1;
+
+		if (cells[pos] != E_EMPTY)
+			return false;
+
+		const auto     backup_cells = cells;
+		const uint64_t backup_hash  = hash;
+
+		const uint8_t me       = c == C_BLACK ? E_BLACK : E_WHITE;
+		const uint8_t opponent = c == C_BLACK ? E_WHITE : E_BLACK;
+
+		set(pos, me);
+
+		for(const int n : { pos - 1, pos + 1, pos - stride, pos + stride }) {
+			if (cells[n] == opponent && has_liberty(n) == false)
+				remove_group(n);
+		}
+
+		// suicide or a position that was seen before
+		if (has_liberty(pos) == false || history.find(hash) != history.end()) {
+			cells = backup_cells;
+			hash  = backup_hash;
+
+			return false;
+		}
+
+		history.insert(hash);
+
+		return true;
+	}
+
+	int score() const override
+	{
+		int            n[4] { 0, 0, 0, 0 };
+		const uint32_t m = new_mark();
+
+		for(int pos=0; pos<n_cells; pos++) {
+			if (cells[pos] != E_EMPTY) {
+				n[cells[pos]]++;
+				continue;
+			}
+
+			if (mark[pos] == m)
+				continue;
+
+			// empty area: counts for a color when only that color borders it
+			int  size        = 0;
+			bool reach[4]    { false, false, false, false };
+			int  sp          = 0;
+
+			stack[sp++] = pos;
+			mark[pos]   = m;
+
+			while(sp > 0) {
+				const int cur = stack[--sp];
+
+				size++;
+
+				for(const int nb : { cur - 1, cur + 1, cur - stride, cur + stride }) {
+					if (cells[nb] == E_EMPTY) {
+						if (mark[nb] != m) {
+							mark[nb] = m;
+							stack[sp++] = nb;
+						}
+					}
+					else {
+						reach[cells[nb]] = true;
+					}
+				}
+			}
+
+			if (reach[E_BLACK] && !reach[E_WHITE])
+				n[E_BLACK] += size;
+			else if (reach[E_WHITE] && !reach[E_BLACK])
+				n[E_WHITE] += size;
+		}
+
+		return n[E_BLACK] - n[E_WHITE];
+	}
+};
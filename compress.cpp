@@ -0,0 +1,234 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <functional>
+#include <optional>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include "compress.h"
+#include "error.h"
+
+
+static bool ends_with(const std::string & in, const std::string & what)
+{
+	return in.size() >= what.size() && in.compare(in.size() - what.size(), what.size(), what) == 0;
+}
+
+compression_t compression_of(const std::string & file)
+{
+	if (ends_with(file, ".gz")) {
+#if defined(HAVE_ZLIB)
+		return CT_GZIP;
+#else
+		error_exit(false, "\"%s\": badank was built without zlib", file.c_str());
+#endif
+	}
+
+	if (ends_with(file, ".zst")) {
+#if defined(HAVE_ZSTD)
+		return CT_ZSTD;
+#else
+		error_exit(false, "\"%s\": badank was built without zstd", file.c_str());
+#endif
+	}
+
+	return CT_NONE;
+}
+
+std::string compress_block(const compression_t ct, const std::string & in)
+{
+#if defined(HAVE_ZLIB)
+	if (ct == CT_GZIP) {
+		z_stream zs { };
+
+		// 16: gzip header and trailer
+		if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			error_exit(false, "deflateInit2 failed");
+
+		std::string out;
+		out.resize(deflateBound(&zs, in.size()) + 32);
+
+		zs.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+		zs.avail_in  = in.size();
+		zs.next_out  = reinterpret_cast<Bytef *>(out.data());
+		zs.avail_out = out.size();
+
+		int rc = deflate(&zs, Z_FINISH);
+
+		out.resize(zs.total_out);
+
+		deflateEnd(&zs);
+
+		if (rc != Z_STREAM_END)
+			error_exit(false, "deflate failed (%d)", rc);
+
+		return out;
+	}
+#endif
+
+#if defined(HAVE_ZSTD)
+	if (ct == CT_ZSTD) {
+		std::string out;
+		out.resize(ZSTD_compressBound(in.size()));
+
+		size_t rc = ZSTD_compress(out.data(), out.size(), in.data(), in.size(), 3);
+
+		if (ZSTD_isError(rc))
+			error_exit(false, "ZSTD_compress failed: %s", ZSTD_getErrorName(rc));
+
+		out.resize(rc);
+
+		return out;
+	}
+#endif
+
+	return in;
+}
+
+#if defined(HAVE_ZLIB)
+static void gunzip(FILE *const fh, char *const in, const size_t in_size, size_t n, const std::function<void(const char *const data, const size_t n)> & cb)
+{
+	z_stream zs { };
+
+	// 32: gzip or zlib, detected from the header
+	if (inflateInit2(&zs, 15 + 32) != Z_OK)
+		return;
+
+	zs.next_in  = reinterpret_cast<Bytef *>(in);
+	zs.avail_in = n;
+
+	char buffer[65536];
+	bool drained = true;  // inflate() has no output pending
+
+	for(;;) {
+		if (zs.avail_in == 0 && drained) {
+			n = fread(in, 1, in_size, fh);
+
+			if (n == 0)  // maybe in the middle of a member that was not written completely
+				break;
+
+			zs.next_in  = reinterpret_cast<Bytef *>(in);
+			zs.avail_in = n;
+		}
+
+		zs.next_out  = reinterpret_cast<Bytef *>(buffer);
+		zs.avail_out = sizeof buffer;
+
+		int rc = inflate(&zs, Z_NO_FLUSH);
+
+		if (zs.avail_out < sizeof buffer)
+			cb(buffer, sizeof buffer - zs.avail_out);
+
+		drained = zs.avail_out > 0;
+
+		if (rc == Z_STREAM_END) {
+			// the next member (block)
+			if (inflateReset(&zs) != Z_OK)
+				break;
+		}
+		else if (rc != Z_OK && rc != Z_BUF_ERROR) {  // e.g. garbage after the last member
+			break;
+		}
+	}
+
+	inflateEnd(&zs);
+}
+#endif
+
+#if defined(HAVE_ZSTD)
+static void unzstd(FILE *const fh, char *const in, const size_t in_size, const size_t n, const std::function<void(const char *const data, const size_t n)> & cb)
+{
+	ZSTD_DStream *ds = ZSTD_createDStream();
+	if (!ds)
+		return;
+
+	ZSTD_initDStream(ds);
+
+	ZSTD_inBuffer input { in, n, 0 };
+
+	char buffer[65536];
+	bool drained = true;
+
+	for(;;) {
+		if (input.pos == input.size && drained) {
+			// a frame that was not written completely just ends here
+			input = { in, fread(in, 1, in_size, fh), 0 };
+
+			if (input.size == 0)
+				break;
+		}
+
+		ZSTD_outBuffer output { buffer, sizeof buffer, 0 };
+
+		size_t rc = ZSTD_decompressStream(ds, &output, &input);
+
+		if (output.pos)
+			cb(buffer, output.pos);
+
+		if (ZSTD_isError(rc))
+			break;
+
+		drained = output.pos < output.size;
+	}
+
+	ZSTD_freeDStream(ds);
+}
+#endif
+
+bool read_file(const std::string & file, const std::function<void(const char *const data, const size_t n)> & cb)
+{
+	FILE *fh = fopen(file.c_str(), "rb");
+	if (!fh)
+		return false;
+
+	char   buffer[65536];
+	size_t n = fread(buffer, 1, sizeof buffer, fh);
+
+	const uint8_t *p = reinterpret_cast<const uint8_t *>(buffer);
+
+	bool done = false;
+
+#if defined(HAVE_ZLIB)
+	if (n >= 2 && p[0] == 0x1f && p[1] == 0x8b) {
+		gunzip(fh, buffer, sizeof buffer, n, cb);
+		done = true;
+	}
+#endif
+
+#if defined(HAVE_ZSTD)
+	if (n >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd) {
+		unzstd(fh, buffer, sizeof buffer, n, cb);
+		done = true;
+	}
+#endif
+
+	(void)p;
+
+	while(done == false && n > 0) {
+		cb(buffer, n);
+
+		n = fread(buffer, 1, sizeof buffer, fh);
+	}
+
+	fclose(fh);
+
+	return true;
+}
+
+std::optional<std::string> read_file(const std::string & file)
+{
+	std::string data;
+
+	if (read_file(file, [&data](const char *const part, const size_t n) { data.append(part, n); }) == false)
+		return { };
+
+	return data;
+}
@@ -0,0 +1,26 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+
+
+typedef enum { CT_NONE, CT_GZIP, CT_ZSTD } compression_t;
+
+// from the name of the file (".gz", ".zst"); terminates the program when
+// that compression was not available when badank was built
+compression_t compression_of(const std::string & file);
+
+// a complete gzip member or zstd frame. A file that consists of these can
+// be read up to the last one that was written completely.
+std::string compress_block(const compression_t ct, const std::string & in);
+
+// the contents of a file, decompressed when it is gzip or zstd (of a
+// partially written file: what could be decompressed)
+std::optional<std::string> read_file(const std::string & file);
+// the same, in parts of at most 64 kB: for files that do not need to be in
+// memory as a whole. false when the file cannot be opened.
+bool read_file(const std::string & file, const std::function<void(const char *const data, const size_t n)> & cb);
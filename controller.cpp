@@ -0,0 +1,196 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <chrono>
+#include <dirent.h>
+#include <mutex>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include "controller.h"
+#include "log.h"
+#include "str.h"
+
+
+// run-time and run-queue wait-time of all threads of a process
+static bool get_schedstat(const pid_t pid, uint64_t *const run_ns, uint64_t *const wait_ns)
+{
+	DIR *dir = opendir(myformat("/proc/%d/task", pid).c_str());
+	if (!dir)
+		return false;
+
+	*run_ns  = 0;
+	*wait_ns = 0;
+
+	while(dirent *entry = readdir(dir)) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		FILE *fh = fopen(myformat("/proc/%d/task/%s/schedstat", pid, entry->d_name).c_str(), "r");
+		if (!fh)
+			continue;
+
+		unsigned long long run = 0, wait = 0;
+
+		if (fscanf(fh, "%llu %llu", &run, &wait) == 2) {
+			*run_ns  += run;
+			*wait_ns += wait;
+		}
+
+		fclose(fh);
+	}
+
+	closedir(dir);
+
+	return true;
+}
+
+// number of threads that are running or want to run, on the whole system
+static int get_procs_running()
+{
+	FILE *fh = fopen("/proc/stat", "r");
+	if (!fh)
+		return -1;
+
+	int  n = -1;
+	char buffer[4096];
+
+	while(fgets(buffer, sizeof buffer, fh)) {
+		if (strncmp(buffer, "procs_running ", 14) == 0) {
+			n = atoi(&buffer[14]);
+			break;
+		}
+	}
+
+	fclose(fh);
+
+	return n;
+}
+
+ConcurrencyController::ConcurrencyController(const int min_active, const int max_active, const int interval_ms, const double max_delay) :
+	min_active(min_active),
+	max_active(max_active),
+	interval_ms(interval_ms),
+	max_delay(max_delay),
+	active(min_active)
+{
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+
+	if (sched_getaffinity(0, sizeof allowed, &allowed) == 0)
+		n_cpus = CPU_COUNT(&allowed);
+
+	dolog(info, "Concurrency will be between %d and %d (%d cpus)", min_active, max_active, n_cpus);
+
+	th = new std::thread(&ConcurrencyController::run, this);
+}
+
+ConcurrencyController::~ConcurrencyController()
+{
+	stop = true;
+
+	th->join();
+	delete th;
+}
+
+void ConcurrencyController::run()
+{
+	while(!stop) {
+		// short sleeps so that the destructor does not have to wait long
+		for(int t=0; t<interval_ms && !stop; t += 100)
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		if (!stop)
+			sample();
+	}
+}
+
+void ConcurrencyController::sample()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	uint64_t d_run  = 0;
+	uint64_t d_wait = 0;
+
+	for(auto & it : pids) {
+		uint64_t run_ns = 0, wait_ns = 0;
+
+		if (get_schedstat(it.first, &run_ns, &wait_ns) == false)
+			continue;
+
+		d_run  += run_ns  - std::min(run_ns,  it.second.run_ns);
+		d_wait += wait_ns - std::min(wait_ns, it.second.wait_ns);
+
+		it.second.run_ns  = run_ns;
+		it.second.wait_ns = wait_ns;
+	}
+
+	// this process itself is one of them
+	int    running = get_procs_running() - 1;
+	double load    = running / double(n_cpus);
+
+	double delay   = d_run + d_wait ? d_wait / double(d_run + d_wait) : 0.;
+
+	double tight   = n_moves ? n_tight_moves / double(n_moves) : 0.;
+
+	int    prev    = active;
+
+	if (load > 1.0 || delay > max_delay || tight > 0.05)
+		active = std::max(min_active, active - 1);
+	else if (load < 0.85 && delay < max_delay / 2 && n_tight_moves == 0)
+		active = std::min(max_active, active + 1);
+
+	dolog(debug, "Load %.2f, engines waited %.1f%% for a cpu, %d of %d moves close to their limit: %d games in parallel", load, delay * 100, n_tight_moves, n_moves, active);
+
+	if (active != prev)
+		dolog(info, "Number of games in parallel changed from %d to %d (load %.2f, cpu wait %.1f%%)", prev, active, load, delay * 100);
+
+	n_moves       = 0;
+	n_tight_moves = 0;
+}
+
+bool ConcurrencyController::may_start(const int slot)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	return slot < active;
+}
+
+void ConcurrencyController::add_pid(const pid_t pid)
+{
+	schedstat_t entry { 0, 0 };
+
+	if (pid <= 0 || get_schedstat(pid, &entry.run_ns, &entry.wait_ns) == false)
+		return;
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	pids[pid] = entry;
+}
+
+void ConcurrencyController::remove_pid(const pid_t pid)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	pids.erase(pid);
+}
+
+void ConcurrencyController::report_move(const uint64_t took_ns, const uint64_t allowed_ns)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	n_moves++;
+
+	if (took_ns > allowed_ns * 9 / 10)
+		n_tight_moves++;
+}
+
+int ConcurrencyController::get_active()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	return active;
+}
@@ -0,0 +1,60 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+// varies the number of games that are played at the same time between
+// 'min' and 'max', depending on how busy the system is
+class ConcurrencyController
+{
+private:
+	const int    min_active;
+	const int    max_active;
+	const int    interval_ms;
+	const double max_delay;  // fraction of time an engine may wait for a cpu
+
+	int          n_cpus { 1 };
+
+	std::mutex              lock;
+	int                     active;
+	std::atomic_bool        stop     { false };
+
+	// engines of games in progress: run- and wait-time (ns) at the previous sample
+	typedef struct {
+		uint64_t run_ns;
+		uint64_t wait_ns;
+	} schedstat_t;
+
+	std::map<pid_t, schedstat_t> pids;
+
+	// moves since the previous sample, 'tight' ones came close to their time limit
+	int n_moves       { 0 };
+	int n_tight_moves { 0 };
+
+	std::thread *th { nullptr };
+
+	void run();
+	void sample();
+
+public:
+	ConcurrencyController(const int min_active, const int max_active, const int interval_ms, const double max_delay);
+	~ConcurrencyController();
+
+	// whether the game of 'slot' (0...max) may be started now
+	bool may_start(const int slot);
+
+	void add_pid(const pid_t pid);
+	void remove_pid(const pid_t pid);
+
+	void report_move(const uint64_t took_ns, const uint64_t allowed_ns);
+
+	int get_active();
+};
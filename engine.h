@@ -0,0 +1,30 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+
+#include "latency.h"
+#include "Glicko2/glicko/rating.hpp"
+
+
+typedef struct {
+	std::string command, directory, alt_name;
+	std::string name;
+	bool target;
+
+	std::mutex lock;
+	Glicko::Rating rating;
+
+	// what list_commands returned, only asked once per engine
+	std::optional<std::set<std::string> > commands;
+
+	// for the metrics and reports, updated without locking
+	engine_latency_t latency;
+	std::atomic_int  n_time_losses { 0 };
+} engine_parameters_t;
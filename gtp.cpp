@@ -1,181 +1,365 @@
 // (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
 // Released under MIT license
 
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <stdlib.h>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
 
 #include "color.h"
 #include "gtp.h"
 #include "log.h"
 #include "proc.h"
 #include "str.h"
+#include "time.h"
+
+static int command_timeout_ms = 10000;
+
+void set_gtp_command_timeout(const int timeout_ms)
+{
+	command_timeout_ms = timeout_ms;
+}
 
 GtpEngine::GtpEngine(const std::string & program, const std::string & dir, const std::string & alt_name) : program(program), name(alt_name)
 {
-	engine = new TextProgram(program, dir);
+	engine = new TextProgram(program, dir, [this](const std::optional<std::string_view> line) { process_line(line); });
 }
 
 GtpEngine::~GtpEngine()
 {
+	// the deadlines of commands that were answered may still be pending
+	engine->getReactor()->remove_timers(this);
+
 	delete engine;
 }
 
-std::optional<std::vector<std::string> > GtpEngine::getresponse(const std::optional<int> timeout_ms)
+// runs in the reactor thread: the lines point into the read-buffer of the
+// TextProgram, only the payload of a response is copied
+void GtpEngine::process_line(const std::optional<std::string_view> line)
 {
-	std::vector<std::string> out;
+	std::unique_lock<std::mutex> lck(lock);
 
-	bool has_is = false;
+	if (line.has_value() == false) {
+		dolog(debug, "%s> (end of file)", name.c_str());
 
-	for(;;) {
-		auto rc = engine->read(timeout_ms);
-		if (rc.has_value() == false) {
-			dolog(warning, "Failed reading from %s", name.c_str());
-			return { };
-		}
+		eof = true;
+		cv.notify_all();
+
+		// nothing is coming anymore
+		auto waiting = std::move(handlers);
+		handlers.clear();
+
+		lck.unlock();
+
+		for(auto & h : waiting)
+			h.second({ }, false);
 
-		if (rc.value().size() >= 1) {
-			dolog(debug, "%s> %s", name.c_str(), rc.value().c_str());
+		return;
+	}
+
+	std::string_view work = line.value();
 
-			if (rc.value().at(0) == '=' || has_is) {
-				std::string add = rc.value();
+	if (work.empty()) {
+		dolog(debug, "%s>---", name.c_str());
 
-				if (has_is == false) {
-					has_is = true;
+		if (in_response) {
+			auto it = sent_at.find(current_id);
 
-					std::size_t space = add.find(' ');
-					if (space != std::string::npos)
-						add = add.substr(space + 1);
-				}
+			if (it != sent_at.end()) {
+				if (command_latency)
+					command_latency->add((get_ts_ns() - it->second) / 1000);
 
-				out.push_back(add);
+				sent_at.erase(it);
 			}
-			else if (rc.value().at(0) == '?') {
-				dolog(warning, "Program %s returned an error: %s", name.c_str(), rc.value().c_str());
-				return { };
+
+			std::optional<response_handler_t>         handler;
+			std::optional<std::vector<std::string> >  response;
+
+			if (auto h = handlers.find(current_id); h != handlers.end()) {
+				handler = std::move(h->second);
+				handlers.erase(h);
+
+				if (current_ok)
+					response = std::move(current);
+			}
+			else if (abandoned.erase(current_id) == 0) {
+				if (current_ok)
+					responses[current_id] = std::move(current);
+				else
+					responses[current_id] = { };
+			}
+
+			current.clear();
+			in_response = false;
+
+			cv.notify_all();
+
+			if (handler.has_value()) {
+				lck.unlock();
+
+				handler.value()(std::move(response), false);
 			}
 		}
-		else {
-			dolog(debug, "%s>---", name.c_str());
-			break;
+
+		return;
+	}
+
+	dolog(debug, "%s> %.*s", name.c_str(), int(work.size()), work.data());
+
+	if (in_response == false) {
+		if (work.at(0) != '=' && work.at(0) != '?')  // not part of a response
+			return;
+
+		in_response = true;
+		current_ok  = work.at(0) == '=';
+
+		if (current_ok == false)
+			dolog(warning, "Program %s returned an error: %.*s", name.c_str(), int(work.size()), work.data());
+
+		// "=12 D4": an id, optionally followed by the payload
+		size_t digits = 1;
+		while(digits < work.size() && isdigit(work.at(digits)))
+			digits++;
+
+		if (digits > 1)
+			current_id = atoi(std::string(work.substr(1, digits - 1)).c_str());
+		else if (outstanding.empty() == false)  // engine did not return the id
+			current_id = outstanding.front();
+		else
+			current_id = -1;
+
+		for(auto it = outstanding.begin(); it != outstanding.end(); it++) {
+			if (*it == current_id) {
+				outstanding.erase(it);
+				break;
+			}
 		}
+
+		work.remove_prefix(digits);
+
+		if (work.empty() == false && work.at(0) == ' ')
+			work.remove_prefix(1);
 	}
 
-	if (out.empty())
-		return { };
+	if (current_ok)
+		current.emplace_back(work);
+}
 
-	return out;
+// runs in the reactor thread
+void GtpEngine::expired(const int id)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	auto it = handlers.find(id);
+
+	// answered in time
+	if (it == handlers.end())
+		return;
+
+	auto handler = std::move(it->second);
+	handlers.erase(it);
+
+	abandoned.insert(id);
+
+	lck.unlock();
+
+	dolog(warning, "Timeout reading from %s", name.c_str());
+
+	handler({ }, true);
 }
 
-std::optional<std::string> GtpEngine::genmove(const color_t c)
+std::optional<int> GtpEngine::send(const std::string & cmd)
 {
-	std::string cmd = myformat("genmove %c", c == C_WHITE ? 'w' : 'b');
+	return send_command(cmd, nullptr);
+}
 
-	dolog(debug, "%s< %s", name.c_str(), cmd.c_str());
+bool GtpEngine::send(const std::string & cmd, const std::optional<int> timeout_ms, const response_handler_t & handler)
+{
+	auto id = send_command(cmd, &handler);
 
-	if (engine->write(cmd)) {
-		auto rc = getresponse({ });
+	if (id.has_value() == false)
+		return false;
 
-		if (rc.has_value())
-			return rc.value().at(0);
-	}
+	uint64_t deadline = get_ts_ns() + timeout_ms.value_or(command_timeout_ms) * 1000000ull;
 
-	return { };
+	engine->getReactor()->add_timer(deadline, this, [this, id] { expired(id.value()); });
+
+	return true;
 }
 
-bool GtpEngine::play(const color_t c, const std::string & vertex)
+// the handler is registered before the command is written: the response
+// can arrive right away
+std::optional<int> GtpEngine::send_command(const std::string & cmd, const response_handler_t *const handler)
 {
-	std::string cmd = myformat("play %c %s", c == C_WHITE ? 'w' : 'b', vertex.c_str());
+	std::unique_lock<std::mutex> lck(lock);
+
+	// it would never be invoked
+	if (handler && eof)
+		return { };
 
-	dolog(debug, "%s< %s", name.c_str(), cmd.c_str());
+	int id = next_id++;
 
-	if (engine->write(cmd))
-		return getresponse({ }).has_value();
+	if (handler)
+		handlers[id] = *handler;
 
-	return false;
+	outstanding.push_back(id);
+
+	// genmoves are measured by the caller, per phase of the game
+	if (command_latency && cmd.compare(0, 7, "genmove") != 0)
+		sent_at[id] = get_ts_ns();
+
+	dolog(debug, "%s< %d %s", name.c_str(), id, cmd.c_str());
+
+	// a write can block when the engine is busy writing: the reactor thread must be able to continue
+	lck.unlock();
+
+	if (engine->write(myformat("%d %s", id, cmd.c_str())) == false) {
+		lck.lock();
+
+		// else it was invoked already (end-of-file)
+		if (handler && handlers.erase(id) == 0)
+			return id;
+
+		sent_at.erase(id);
+
+		for(auto it = outstanding.begin(); it != outstanding.end(); it++) {
+			if (*it == id) {
+				outstanding.erase(it);
+				break;
+			}
+		}
+
+		return { };
+	}
+
+	return id;
 }
 
-bool GtpEngine::setkomi(const double komi)
+std::optional<std::vector<std::string> > GtpEngine::wait(const int id, const std::optional<int> timeout_ms, bool *const timed_out)
 {
-	std::string cmd = myformat("komi %f", komi);
+	std::unique_lock<std::mutex> lck(lock);
 
-	dolog(debug, "%s< %s", name.c_str(), cmd.c_str());
+	auto has_response = [this, id] { return responses.find(id) != responses.end() || eof; };
 
-	if (engine->write(cmd))
-		return getresponse({ }).has_value();
+	if (cv.wait_for(lck, std::chrono::milliseconds(timeout_ms.value_or(command_timeout_ms)), has_response) == false) {
+		dolog(warning, "Timeout reading from %s", name.c_str());
 
-	return false;
+		abandoned.insert(id);
+
+		if (timed_out)
+			*timed_out = true;
+
+		return { };
+	}
+
+	auto it = responses.find(id);
+
+	if (it == responses.end()) {
+		dolog(warning, "Failed reading from %s", name.c_str());
+		return { };
+	}
+
+	auto out = std::move(it->second);
+	responses.erase(it);
+
+	return out;
 }
 
-bool GtpEngine::time_settings(const int main_time, const int byo_yomi_time, const int byo_yomi_stones)
+void GtpEngine::set_command_latency(Histogram *const h)
 {
-	std::string cmd = myformat("time_settings %d %d %d", main_time, byo_yomi_time, byo_yomi_stones);
+	std::unique_lock<std::mutex> lck(lock);
 
-	dolog(debug, "%s< %s", name.c_str(), cmd.c_str());
+	command_latency = h;
 
-	if (engine->write(cmd))
-		return getresponse({ }).has_value();
+	if (h == nullptr)
+		sent_at.clear();
+}
 
-	return false;
+bool GtpEngine::wait_ok(const std::optional<int> id, bool *const timed_out)
+{
+	return id.has_value() && wait(id.value(), { }, timed_out).has_value();
 }
 
-bool GtpEngine::time_left(const color_t c, const int time_left_ms, const int n_stones)
+std::optional<std::vector<std::string> > GtpEngine::command(const std::string & cmd, const std::optional<int> timeout_ms, bool *const timed_out)
 {
-	std::string cmd = myformat("time_left %c %d %d", c == C_WHITE ? 'w' : 'b', time_left_ms / 1000, n_stones);
+	auto id = send(cmd);
 
-	dolog(debug, "%s< %s", name.c_str(), cmd.c_str());
+	if (id.has_value() == false)
+		return { };
 
-	if (engine->write(cmd))
-		return getresponse({ }).has_value();
+	return wait(id.value(), timeout_ms, timed_out);
+}
 
-	return false;
+std::optional<std::string> GtpEngine::genmove(const color_t c, const int timeout_ms, bool *const timed_out)
+{
+	auto rc = command(myformat("genmove %c", c == C_WHITE ? 'w' : 'b'), timeout_ms, timed_out);
+
+	if (rc.has_value())
+		return rc.value().at(0);
+
+	return { };
 }
 
-bool GtpEngine::boardsize(const int dim)
+bool GtpEngine::play(const color_t c, const std::string & vertex)
 {
-	dolog(debug, "%s> set board size to %d", name.c_str(), dim);
+	return wait_ok(send(myformat("play %c %s", c == C_WHITE ? 'w' : 'b', vertex.c_str())));
+}
 
-	if (engine->write(myformat("boardsize %d", dim)))
-		return getresponse({ }).has_value();
+bool GtpEngine::setkomi(const double komi)
+{
+	return command(myformat("komi %f", komi), { }).has_value();
+}
+
+bool GtpEngine::time_settings(const int main_time, const int byo_yomi_time, const int byo_yomi_stones)
+{
+	return command(myformat("time_settings %d %d %d", main_time, byo_yomi_time, byo_yomi_stones), { }).has_value();
+}
 
-	return false;
+bool GtpEngine::time_left(const color_t c, const int time_left_ms, const int n_stones)
+{
+	return wait_ok(send(myformat("time_left %c %d %d", c == C_WHITE ? 'w' : 'b', time_left_ms / 1000, n_stones)));
 }
 
-bool GtpEngine::clearboard()
+bool GtpEngine::boardsize(const int dim)
 {
-	if (engine->write("clear_board"))
-		return getresponse({ }).has_value();
+	return command(myformat("boardsize %d", dim), { }).has_value();
+}
 
-	return false;
+bool GtpEngine::clearboard(bool *const timed_out)
+{
+	return command("clear_board", { }, timed_out).has_value();
 }
 
-std::optional<std::string> GtpEngine::getscore()
+std::optional<std::string> GtpEngine::getscore(bool *const timed_out)
 {
-	if (engine->write("final_score")) {
-		auto rc = getresponse({ });
+	auto rc = command("final_score", { }, timed_out);
 
-		if (rc.has_value())
-			return rc.value().at(0);
-	}
+	if (rc.has_value())
+		return rc.value().at(0);
 
 	return { };
 }
 
 std::optional<std::string> GtpEngine::protocol_version()
 {
-	if (engine->write("protocol_version")) {
-		auto rc = getresponse(30000);  // 30s startup time max.
+	auto rc = command("protocol_version", 30000);  // 30s startup time max.
 
-		if (rc.has_value())
-			return rc.value().at(0);
-	}
+	if (rc.has_value())
+		return rc.value().at(0);
 
 	return { };
 }
 
 std::string GtpEngine::getname()
 {
-	if (name.empty() && engine->write("name")) {
-		auto rc = getresponse({ });
+	if (name.empty()) {
+		auto rc = command("name", { });
+
+		std::unique_lock<std::mutex> lck(lock);  // the reactor thread logs it
 
 		if (rc.has_value())
 			name = rc.value().at(0);
@@ -188,24 +372,75 @@ std::string GtpEngine::getname()
 	return name;
 }
 
+bool GtpEngine::has_ended()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	return eof;
+}
+
+void GtpEngine::kill()
+{
+	dolog(info, "Killing %s (%s)", name.c_str(), get_loghelper().c_str());
+
+	engine->kill();
+
+	// nothing is waited for anymore, and it is not re-used
+	std::unique_lock<std::mutex> lck(lock);
+
+	eof = true;
+	cv.notify_all();
+}
+
+uint64_t GtpEngine::get_rtt_ns()
+{
+	if (rtt_ns.has_value())
+		return rtt_ns.value();
+
+	// the fastest one is closest to the pure pipe/scheduling overhead
+	uint64_t fastest = UINT64_MAX;
+
+	for(int i=0; i<5; i++) {
+		uint64_t start_ts = get_ts_ns();
+
+		if (command("name", { }).has_value() == false)
+			break;
+
+		fastest = std::min(fastest, get_ts_ns() - start_ts);
+	}
+
+	rtt_ns = fastest == UINT64_MAX ? 0 : fastest;
+
+	dolog(debug, "Round-trip time of %s: %.3fms", program.c_str(), rtt_ns.value() / 1e6);
+
+	return rtt_ns.value();
+}
+
 std::string GtpEngine::get_loghelper()
 {
 	return myformat("%d", engine->getPid());
 }
 
-bool GtpEngine::has_command(const std::string & command)
+std::optional<std::set<std::string> > GtpEngine::get_commands()
 {
-	if (engine->write("list_commands")) {
-		auto rc = getresponse({ });
-
-		if (rc.has_value() == false)
-			return false;
+	if (commands.has_value() == false) {
+		auto rc = command("list_commands", { });
 
-		for(auto & line : rc.value()) {
-			if (line == command)
-				return true;
-		}
+		if (rc.has_value())
+			commands = std::set<std::string>(rc.value().begin(), rc.value().end());
 	}
 
-	return false;
+	return commands;
+}
+
+void GtpEngine::set_commands(const std::set<std::string> & commands)
+{
+	this->commands = commands;
+}
+
+bool GtpEngine::has_command(const std::string & command)
+{
+	auto rc = get_commands();
+
+	return rc.has_value() && rc.value().find(command) != rc.value().end();
 }
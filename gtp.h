@@ -1,42 +1,123 @@
 // (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
 // Released under MIT license
 
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <optional>
+#include <set>
+#include <stdint.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "color.h"
+#include "histogram.h"
 #include "proc.h"
 
+// limit for commands that should take no time (play, boardsize, komi, etc)
+void set_gtp_command_timeout(const int timeout_ms);
+
+// invoked from a reactor thread with the response of a command (without the
+// "="), or without one after a "?", end-of-file or (timed_out) when its
+// deadline passed. It must not block nor use the engine or the reactor.
+typedef std::function<void(std::optional<std::vector<std::string> > response, const bool timed_out)> response_handler_t;
+
 class GtpEngine
 {
 private:
 	const std::string program;
 	std::string name;
 	TextProgram *engine { nullptr };
+	int         n_games { 0 };
+
+	std::optional<std::set<std::string> > commands;  // result of list_commands
+
+	// round-trip time of a command that takes no effort
+	std::optional<uint64_t> rtt_ns;
+
+	// responses are assembled by the reactor thread and stored by command id
+	std::mutex                                                lock;
+	std::condition_variable                                   cv;
+	int                                                       next_id { 1 };
+	std::deque<int>                                           outstanding;  // in the order they were sent
+	std::set<int>                                             abandoned;    // nobody waits for these anymore
+	std::map<int, std::optional<std::vector<std::string> > >  responses;    // no value: "?" response
+	std::map<int, response_handler_t>                         handlers;     // instead of a response
+	int                                                       current_id  { -1 };
+	std::vector<std::string>                                  current;
+	bool                                                      in_response { false };
+	bool                                                      current_ok  { false };
+	bool                                                      eof         { false };
+
+	// the other commands than genmove are measured when set
+	Histogram                                                *command_latency { nullptr };
+	std::map<int, uint64_t>                                   sent_at;  // id -> get_ts_ns()
+
+	void process_line(const std::optional<std::string_view> line);
+	void expired(const int id);
+
+	std::optional<int> send_command(const std::string & cmd, const response_handler_t *const handler);
 
-	std::optional<std::vector<std::string> > getresponse(const std::optional<int> timeout_ms);
+	std::optional<std::vector<std::string> > command(const std::string & cmd, const std::optional<int> timeout_ms, bool *const timed_out = nullptr);
 
 public:
 	GtpEngine(const std::string & program, const std::string & dir, const std::string & alt_name);
 	~GtpEngine();
 
+	// sends a command prefixed with an id and returns immediately, so that
+	// multiple commands (to one or more engines) can be in flight
+	std::optional<int> send(const std::string & cmd);
+	// returns the response (without the "=") of the command with this id;
+	// without timeout, the one set with set_gtp_command_timeout() applies.
+	// 'timed_out' (if given) is set to true when that is why nothing is
+	// returned, it is left alone otherwise.
+	std::optional<std::vector<std::string> > wait(const int id, const std::optional<int> timeout_ms, bool *const timed_out = nullptr);
+	bool wait_ok(const std::optional<int> id, bool *const timed_out = nullptr);
+	// nobody waits: 'handler' is invoked with the response (or at the
+	// deadline, see above). false (and no handler invocation) when the
+	// command could not be sent.
+	bool send(const std::string & cmd, const std::optional<int> timeout_ms, const response_handler_t & handler);
+
 	bool setkomi(const double komi);
 
 	bool time_settings(const int main_time, const int byo_yomi_time, const int byo_yomi_stones);
 
-	std::optional<std::string> genmove(const color_t c);
+	std::optional<std::string> genmove(const color_t c, const int timeout_ms, bool *const timed_out = nullptr);
 	bool time_left(const color_t c, const int time_left_ms, const int n_stones);
 	bool play(const color_t c, const std::string & vertex);
 
+	// list_commands is only sent once, see also set_commands()
+	std::optional<std::set<std::string> > get_commands();
+	void set_commands(const std::set<std::string> & commands);
 	bool has_command(const std::string & command);
 
 	bool boardsize(const int dim);
-	bool clearboard();
+	bool clearboard(bool *const timed_out = nullptr);
 
-	std::optional<std::string> getscore();
+	std::optional<std::string> getscore(bool *const timed_out = nullptr);
 
 	std::optional<std::string> protocol_version();
 	std::string get_loghelper();
 	std::string getname();
+
+	// measured once per process
+	uint64_t get_rtt_ns();
+
+	void add_game() { n_games++; }
+	int  get_n_games() const { return n_games; }
+
+	// microseconds, nullptr to stop
+	void set_command_latency(Histogram *const h);
+
+	// the program terminated, was killed or sent something that cannot be handled
+	bool has_ended();
+	void kill();
+
+	pid_t get_pid() const { return engine ? engine->getPid() : -1; }
+
+	std::optional<uint64_t> get_cpu_time_ns() const { return engine ? engine->get_cpu_time_ns() : std::optional<uint64_t>(); }
 };
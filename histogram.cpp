@@ -0,0 +1,184 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <inttypes.h>
+#include <optional>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "histogram.h"
+#include "str.h"
+
+
+int histogram_bucket_of(const uint64_t v)
+{
+	if (v < 32)
+		return v;
+
+	int e     = 63 - __builtin_clzll(v);  // 5...63
+	int shift = e - 4;
+
+	return 32 + (e - 5) * 16 + int((v >> shift) - 16);
+}
+
+uint64_t histogram_value_of(const int bucket)
+{
+	if (bucket < 32)
+		return bucket;
+
+	int e     = (bucket - 32) / 16 + 5;
+	int shift = e - 4;
+
+	uint64_t m = (bucket - 32) % 16 + 16;
+
+	if (e == 63 && m == 31)
+		return UINT64_MAX;
+
+	return ((m + 1) << shift) - 1;
+}
+
+void Histogram::add(const uint64_t v)
+{
+	counts[histogram_bucket_of(v)].fetch_add(1, std::memory_order_relaxed);
+
+	n.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(v, std::memory_order_relaxed);
+
+	uint64_t cur = max.load(std::memory_order_relaxed);
+	while(v > cur && !max.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+	}
+}
+
+void Histogram::add(const histogram_snapshot_t & h)
+{
+	for(size_t i=0; i<h.counts.size() && i<size_t(histogram_n_buckets); i++) {
+		if (h.counts[i])
+			counts[i].fetch_add(h.counts[i], std::memory_order_relaxed);
+	}
+
+	n.fetch_add(h.n, std::memory_order_relaxed);
+	sum.fetch_add(h.sum, std::memory_order_relaxed);
+
+	uint64_t cur = max.load(std::memory_order_relaxed);
+	while(h.max > cur && !max.compare_exchange_weak(cur, h.max, std::memory_order_relaxed)) {
+	}
+}
+
+// not atomic as a whole: a value that is added meanwhile may be missing from
+// 'n' but not from 'counts' or the other way around
+histogram_snapshot_t Histogram::snapshot() const
+{
+	histogram_snapshot_t out { std::vector<uint64_t>(histogram_n_buckets), 0, 0, 0 };
+
+	for(int i=0; i<histogram_n_buckets; i++)
+		out.counts[i] = counts[i].load(std::memory_order_relaxed);
+
+	out.n   = n.load(std::memory_order_relaxed);
+	out.sum = sum.load(std::memory_order_relaxed);
+	out.max = max.load(std::memory_order_relaxed);
+
+	return out;
+}
+
+void histogram_merge(histogram_snapshot_t *const to, const histogram_snapshot_t & from)
+{
+	if (to->counts.empty())
+		to->counts.resize(histogram_n_buckets);
+
+	for(size_t i=0; i<from.counts.size(); i++)
+		to->counts[i] += from.counts[i];
+
+	to->n   += from.n;
+	to->sum += from.sum;
+	to->max  = std::max(to->max, from.max);
+}
+
+uint64_t histogram_quantile(const histogram_snapshot_t & h, const double q)
+{
+	uint64_t total = 0;
+
+	for(auto c : h.counts)
+		total += c;
+
+	if (total == 0)
+		return 0;
+
+	uint64_t rank = std::max(uint64_t(1), uint64_t(ceil(q * total)));
+	uint64_t seen = 0;
+
+	for(size_t i=0; i<h.counts.size(); i++) {
+		seen += h.counts[i];
+
+		if (seen >= rank)
+			return std::min(histogram_value_of(i), h.max);
+	}
+
+	return h.max;
+}
+
+uint64_t histogram_count_above(const histogram_snapshot_t & h, const uint64_t v)
+{
+	uint64_t out = 0;
+
+	// the buckets of which the lowest value is above 'v'
+	for(size_t i=histogram_bucket_of(v) + 1; i<h.counts.size(); i++)
+		out += h.counts[i];
+
+	return out;
+}
+
+std::string histogram_to_string(const histogram_snapshot_t & h)
+{
+	std::string out = myformat("%" PRIu64 " %" PRIu64, h.sum, h.max);
+
+	bool first = true;
+
+	for(size_t i=0; i<h.counts.size(); i++) {
+		if (h.counts[i] == 0)
+			continue;
+
+		out += myformat("%c%zu:%" PRIu64, first ? ' ' : ',', i, h.counts[i]);
+
+		first = false;
+	}
+
+	return out;
+}
+
+std::optional<histogram_snapshot_t> histogram_from_string(const std::string & in)
+{
+	auto parts = split_fields(in, ' ');
+
+	if (parts.size() < 2 || parts.size() > 3)
+		return { };
+
+	histogram_snapshot_t out { std::vector<uint64_t>(histogram_n_buckets), 0, 0, 0 };
+
+	out.sum = strtoull(parts.at(0).c_str(), nullptr, 10);
+	out.max = strtoull(parts.at(1).c_str(), nullptr, 10);
+
+	if (parts.size() == 3) {
+		for(auto & bucket : split_fields(parts.at(2), ',')) {
+			auto pair = split_fields(bucket, ':');
+
+			if (pair.size() != 2)
+				return { };
+
+			int      i = atoi(pair.at(0).c_str());
+			uint64_t n = strtoull(pair.at(1).c_str(), nullptr, 10);
+
+			if (i < 0 || i >= histogram_n_buckets)
+				return { };
+
+			out.counts[i] += n;
+			out.n         += n;
+		}
+	}
+
+	return out;
+}
@@ -0,0 +1,52 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+// 32 buckets of 1, then per power of 2 16 buckets: at most 1/16th wide
+constexpr int histogram_n_buckets = 32 + 59 * 16;
+
+typedef struct {
+	std::vector<uint64_t> counts;  // histogram_n_buckets
+	uint64_t n, sum, max;
+} histogram_snapshot_t;
+
+// values (e.g. latencies in microseconds) counted in buckets of a few percent
+// wide, like HdrHistogram. add() is lock-free: all threads can add to one
+// histogram while an other one takes a snapshot.
+class Histogram
+{
+private:
+	std::atomic_uint64_t counts[histogram_n_buckets] { };
+	std::atomic_uint64_t n   { 0 };
+	std::atomic_uint64_t sum { 0 };
+	std::atomic_uint64_t max { 0 };
+
+public:
+	void add(const uint64_t v);
+	// e.g. what a worker measured
+	void add(const histogram_snapshot_t & h);
+
+	histogram_snapshot_t snapshot() const;
+};
+
+int      histogram_bucket_of(const uint64_t v);
+// the highest value that is counted in this bucket
+uint64_t histogram_value_of(const int bucket);
+
+void     histogram_merge(histogram_snapshot_t *const to, const histogram_snapshot_t & from);
+// 'q' from 0 to 1 (e.g. 0.99), 0 when nothing was counted
+uint64_t histogram_quantile(const histogram_snapshot_t & h, const double q);
+// (about) how many values were larger than 'v'
+uint64_t histogram_count_above(const histogram_snapshot_t & h, const uint64_t v);
+
+// "sum max bucket:count,bucket:count..." (only the buckets in use)
+std::string histogram_to_string(const histogram_snapshot_t & h);
+std::optional<histogram_snapshot_t> histogram_from_string(const std::string & in);
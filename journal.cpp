@@ -0,0 +1,130 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <inttypes.h>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "error.h"
+#include "journal.h"
+#include "log.h"
+#include "str.h"
+#include "time.h"
+
+
+#define JOURNAL_HEADER "badank journal 1"
+
+Journal::Journal(const std::string & file, const std::vector<engine_parameters_t *> & engines, const std::string & fingerprint, const int sync_interval_ms) :
+	engines(engines),
+	sync_interval_ms(sync_interval_ms)
+{
+	fh = fopen(file.c_str(), "a+");
+	if (fh == nullptr)
+		error_exit(true, "Cannot open journal \"%s\"", file.c_str());
+
+	rewind(fh);
+
+	std::string header = JOURNAL_HEADER "\t" + fingerprint;
+
+	// offset after the last complete line: a crash may have left half a line
+	long valid_end = 0;
+	bool first     = true;
+
+	char  *line = nullptr;
+	size_t len  = 0;
+
+	for(;;) {
+		ssize_t n = getline(&line, &len, fh);
+
+		if (n <= 0 || line[n - 1] != '\n')
+			break;
+
+		std::string work(line, n - 1);
+
+		if (first) {
+			if (work != header)
+				error_exit(false, "Journal \"%s\" belongs to an other configuration, remove it to start over", file.c_str());
+
+			first = false;
+		}
+		else {
+			auto parts = split_fields(work, '\t');
+
+			size_t b = parts.size() == 6 ? atoi(parts.at(1).c_str()) : engines.size();
+			size_t w = parts.size() == 6 ? atoi(parts.at(2).c_str()) : engines.size();
+
+			// a complete line: it stays in the file, only this game is played again
+			if (b >= engines.size() || w >= engines.size())
+				dolog(warning, "Journal \"%s\": ignoring the entry \"%s\"", file.c_str(), work.c_str());
+			else {
+				journal_entry_t e { atoi(parts.at(0).c_str()), engines.at(b), engines.at(w), { }, atoi(parts.at(4).c_str()), strtoull(parts.at(5).c_str(), nullptr, 10) };
+
+				if (parts.at(3).empty() == false)
+					e.result = parts.at(3);
+
+				entries.push_back(e);
+			}
+		}
+
+		valid_end = ftell(fh);
+	}
+
+	free(line);
+
+	// appended entries should start on a line of their own
+	if (ftruncate(fileno(fh), valid_end) == -1)
+		error_exit(true, "Cannot truncate journal \"%s\"", file.c_str());
+
+	fseek(fh, 0, SEEK_END);
+
+	if (first) {
+		fprintf(fh, "%s\n", header.c_str());
+		fflush(fh);
+		fsync(fileno(fh));
+	}
+
+	if (entries.empty() == false)
+		dolog(info, "Journal \"%s\": %zu games were played before", file.c_str(), entries.size());
+
+	last_sync = get_ts_ms();
+}
+
+Journal::~Journal()
+{
+	fflush(fh);
+	fsync(fileno(fh));
+
+	fclose(fh);
+}
+
+int Journal::index_of(const engine_parameters_t *const ep) const
+{
+	for(size_t i=0; i<engines.size(); i++) {
+		if (engines.at(i) == ep)
+			return i;
+	}
+
+	return -1;
+}
+
+void Journal::add(const journal_entry_t & e)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	fprintf(fh, "%d\t%d\t%d\t%s\t%d\t%" PRIu64 "\n", e.nr, index_of(e.p1), index_of(e.p2), e.result.has_value() ? e.result.value().c_str() : "", e.rr, e.took);
+
+	// at most 'sync_interval_ms' of results get lost when the host goes down
+	fflush(fh);
+
+	uint64_t now = get_ts_ms();
+
+	if (now - last_sync >= uint64_t(sync_interval_ms)) {
+		fsync(fileno(fh));
+
+		last_sync = now;
+	}
+}
@@ -0,0 +1,50 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+
+
+typedef struct {
+	int                        nr;
+	engine_parameters_t       *p1, *p2;  // black, white
+	std::optional<std::string> result;   // nothing when the game failed
+	int                        rr;       // run_result_t
+	uint64_t                   took;     // nanoseconds
+} journal_entry_t;
+
+// append-only list of the games that were finished, so that an interrupted
+// tournament can continue where it stopped. 'fingerprint' describes the
+// configuration; a journal of an other configuration is not used.
+class Journal
+{
+private:
+	const std::vector<engine_parameters_t *> engines;
+	const int                                sync_interval_ms;
+
+	FILE    *fh { nullptr };
+	uint64_t last_sync { 0 };
+
+	std::mutex lock;
+
+	std::vector<journal_entry_t> entries;  // from an earlier run
+
+	int index_of(const engine_parameters_t *const ep) const;
+
+public:
+	// terminates the program when the file cannot be used
+	Journal(const std::string & file, const std::vector<engine_parameters_t *> & engines, const std::string & fingerprint, const int sync_interval_ms);
+	~Journal();
+
+	const std::vector<journal_entry_t> & get_entries() const { return entries; }
+
+	void add(const journal_entry_t & e);
+};
@@ -0,0 +1,107 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <algorithm>
+#include <inttypes.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "histogram.h"
+#include "latency.h"
+#include "log.h"
+#include "str.h"
+
+
+game_phase_t game_phase_of(const int move_nr, const int dim)
+{
+	int n = dim * dim;
+
+	if (move_nr < n / 6)
+		return GP_OPENING;
+
+	if (move_nr < n / 2)
+		return GP_MIDDLE;
+
+	return GP_END;
+}
+
+std::string game_phase_name(const game_phase_t p)
+{
+	if (p == GP_OPENING)
+		return "opening";
+
+	if (p == GP_MIDDLE)
+		return "middle";
+
+	return "endgame";
+}
+
+histogram_snapshot_t genmove_snapshot(const engine_latency_t & l)
+{
+	histogram_snapshot_t out { std::vector<uint64_t>(histogram_n_buckets), 0, 0, 0 };
+
+	for(int p=0; p<GP_N; p++)
+		histogram_merge(&out, l.genmove[p].snapshot());
+
+	return out;
+}
+
+void log_latency_report(const std::vector<std::pair<std::string, const engine_latency_t *> > & engines, const double main_time)
+{
+	size_t name_width = 6;
+
+	for(auto & e : engines)
+		name_width = std::max(name_width, e.first.size());
+
+	dolog(info, "Latency (ms):");
+	dolog(info, "%-*s %-8s %7s %9s %9s %9s %9s %6s", int(name_width), "engine", "", "n", "p50", "p90", "p99", "max", ">10x");
+
+	std::vector<std::string> warnings;
+
+	for(auto & e : engines) {
+		std::vector<std::pair<std::string, histogram_snapshot_t> > rows;
+
+		for(int p=0; p<GP_N; p++)
+			rows.push_back({ game_phase_name(game_phase_t(p)), e.second->genmove[p].snapshot() });
+
+		rows.push_back({ "genmove", genmove_snapshot(*e.second) });
+		rows.push_back({ "other", e.second->command.snapshot() });
+
+		for(auto & row : rows) {
+			const histogram_snapshot_t & h = row.second;
+
+			if (h.n == 0)
+				continue;
+
+			uint64_t p50 = histogram_quantile(h, 0.5);
+
+			// took much longer than usual (in this phase); not below 100ms, that
+			// is noise (scheduling and such)
+			uint64_t outliers = histogram_count_above(h, std::max(p50 * 10, uint64_t(100000)));
+
+			dolog(info, "%-*s %-8s %7" PRIu64 " %9.1f %9.1f %9.1f %9.1f %6" PRIu64, int(name_width), e.first.c_str(), row.first.c_str(), h.n,
+					p50 / 1000., histogram_quantile(h, 0.9) / 1000., histogram_quantile(h, 0.99) / 1000., h.max / 1000., outliers);
+
+			if (outliers && row.first != "genmove" && row.first != "other")
+				warnings.push_back(myformat("%s: %" PRIu64 " genmove(s) (%s) took more than 10x the median of %.1fms (longest: %.1fms)", e.first.c_str(), outliers, row.first.c_str(), p50 / 1000., h.max / 1000.));
+		}
+	}
+
+	for(auto & w : warnings)
+		dolog(warning, "%s", w.c_str());
+
+	for(auto & e : engines) {
+		int n_games = e.second->n_games;
+
+		if (n_games == 0)
+			continue;
+
+		double per_game = e.second->time_used_ns / 1e9 / n_games;
+
+		if (main_time > 0.)
+			dolog(info, "%s used %.2fs per game (%.1f%% of the main time)", e.first.c_str(), per_game, per_game * 100. / main_time);
+		else
+			dolog(info, "%s used %.2fs per game", e.first.c_str(), per_game);
+	}
+}
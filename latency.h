@@ -0,0 +1,39 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "histogram.h"
+
+
+// by move number (the stones of a book or random opening included): the
+// first 1/6th of the board is the opening, from half of it the endgame
+typedef enum { GP_OPENING, GP_MIDDLE, GP_END, GP_N } game_phase_t;
+
+game_phase_t game_phase_of(const int move_nr, const int dim);
+std::string  game_phase_name(const game_phase_t p);
+
+// per engine, updated without locking by all threads that play games
+typedef struct {
+	Histogram genmove[GP_N];  // microseconds
+	Histogram command;        // the other commands (play, time_left, etc), microseconds
+
+	// charged to the engine (see time_used in game_t) and games
+	std::atomic_uint64_t time_used_ns { 0 };
+	std::atomic_int      n_games      { 0 };
+} engine_latency_t;
+
+// the histograms of all phases
+histogram_snapshot_t genmove_snapshot(const engine_latency_t & l);
+
+// p50/p90/p99/max per engine and phase; warns about engines with genmoves
+// that took more than 10 times their median (and at least 100ms).
+// 'main_time' (seconds) is used for the time usage per game, 0 when it does
+// not apply.
+void log_latency_report(const std::vector<std::pair<std::string, const engine_latency_t *> > & engines, const double main_time);
@@ -2,24 +2,103 @@
 // Released under MIT license
 
 #define _DEFAULT_SOURCE
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <errno.h>
 #include <fcntl.h>
+#include <mutex>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string>
 #include <string.h>
+#include <thread>
 #include <time.h>
 #include <unistd.h>
+#include <vector>
+#include <sys/stat.h>
 
+#include "compress.h"
 #include "error.h"
 #include "log.h"
 #include "time.h"
 
 
-static const char *logfile = nullptr;
-static log_level_t log_level_file = warning;
-static log_level_t log_level_screen = warning;
-static FILE *lfh = nullptr;
+// each thread logs into a buffer of its own, a separate thread writes
+// these to the log-file and the screen
+#define LOG_BUFFER_SIZE       (64 * 1024)  // power of 2
+#define LOG_LINE_MAX          (LOG_BUFFER_SIZE / 4)
+#define LOG_FLUSH_INTERVAL_MS 100
+// a compressed log-file is written in blocks of at least this size, or
+// when the oldest line in it is this old
+#define LOG_BLOCK_SIZE        (128 * 1024)
+#define LOG_BLOCK_MAX_AGE_MS  5000
+
+log_level_t log_level_lowest = warning;
+
+static std::string   logfile;
+static log_level_t   log_level_file   = warning;
+static log_level_t   log_level_screen = warning;
+static int           lfd              = -1;
+static uint64_t      lf_size          = 0;  // on disk, so compressed
+static uint64_t      rotate_size      = 0;
+static int           rotate_keep      = 5;
+static compression_t log_ct           = CT_NONE;  // from the file name
+static std::string   lf_pending;                   // not yet compressed
+static uint64_t      lf_pending_since = 0;
+
+// protects the variables above and the output
+static std::mutex output_lock;
+
+typedef struct {
+	uint64_t    seq;
+	uint64_t    ts;  // milliseconds
+	uint32_t    len;
+	log_level_t ll;
+} record_header_t;
+
+typedef struct {
+	record_header_t h;
+	int             tid;
+	std::string     text;
+} record_t;
+
+// single producer (the thread), single consumer (the flusher)
+typedef struct {
+	char                  data[LOG_BUFFER_SIZE];
+	std::atomic<uint64_t> head     { 0 };
+	std::atomic<uint64_t> tail     { 0 };
+	std::atomic_bool      orphaned { false };  // the thread has terminated
+	int                   tid      { 0 };
+} log_buffer_t;
+
+static std::mutex                  buffers_lock;
+static std::vector<log_buffer_t *> buffers;
+
+static std::atomic<uint64_t> seq { 0 };  // for the order between threads
+
+static std::thread            *flusher      { nullptr };
+static std::atomic_bool        running      { false };
+static std::mutex              flusher_lock;
+static std::condition_variable flusher_cv;
+static bool                    flusher_stop { false };
+static bool                    flusher_wake { false };
+
+static const char *const ll_names[] = { "debug  ", "info   ", "notice ", "warning", "error  " };
+
+typedef struct thread_buffer_owner {
+	log_buffer_t *b { nullptr };
+
+	~thread_buffer_owner() {
+		// the flusher frees it when it is empty
+		if (b)
+			b->orphaned = true;
+	}
+} thread_buffer_owner_t;
+
+static thread_local thread_buffer_owner_t thread_buffer;
 
 log_level_t parse_ll(const std::string & ll)
 {
@@ -43,90 +122,436 @@ log_level_t parse_ll(const std::string & ll)
 	return debug;
 }
 
-void setlog(const char *lf, const log_level_t ll_file, const log_level_t ll_screen)
+// output_lock must be held
+static bool open_logfile()
 {
-	if (lfh) {
-		fclose(lfh);
-		lfh = nullptr;
+	lfd = open(logfile.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+
+	if (lfd == -1) {
+		fprintf(stderr, "Cannot access log-file %s: %s\n", logfile.c_str(), strerror(errno));
+
+		return false;
 	}
 
-	free((void *)logfile);
+	struct stat st { };
 
-	logfile = strdup(lf);
+	lf_size = fstat(lfd, &st) == 0 ? st.st_size : 0;
 
-	log_level_file = ll_file;
-	log_level_screen = ll_screen;
+	return true;
 }
 
-void setlog(const char *lf, const std::string & ll_file, const std::string & ll_screen)
+// output_lock must be held
+static void rotate_logfile()
 {
-	setlog(lf, parse_ll(ll_file), parse_ll(ll_screen));
+	close(lfd);
+	lfd = -1;
+
+	for(int i=rotate_keep - 1; i>=1; i--)
+		rename((logfile + "." + std::to_string(i)).c_str(), (logfile + "." + std::to_string(i + 1)).c_str());
+
+	if (rotate_keep > 0)
+		rename(logfile.c_str(), (logfile + ".1").c_str());
+	else
+		unlink(logfile.c_str());
 }
 
-void closelog()
+// output_lock must be held
+static void format_line(const uint64_t ts, const int tid, const log_level_t ll, const char *const text, const size_t len, std::string *const file_out, std::string *const screen_out)
 {
-	if (lfh) {
-		fclose(lfh);
-		lfh = nullptr;
+	// localtime_r only once per second
+	static time_t cached_t = -1;
+	static char   cached_ts[64];
+
+	time_t t = ts / 1000;
+
+	if (t != cached_t) {
+		struct tm tm { 0 };
+		if (!localtime_r(&t, &tm))
+			fprintf(stderr, "localtime_r: %s\n", strerror(errno));
+
+		snprintf(cached_ts, sizeof cached_ts, "%04d-%02d-%02d %02d:%02d:%02d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+
+		cached_t = t;
+	}
+
+	char prefix[128];
+	int  prefix_len = snprintf(prefix, sizeof prefix, "%s.%03d [%d] %s ", cached_ts, int(ts % 1000), tid, ll_names[ll]);
+
+	if (ll >= log_level_file && logfile.empty() == false) {
+		file_out->append(prefix, prefix_len);
+		file_out->append(text, len);
+		file_out->push_back('\n');
+	}
+
+	if (ll >= log_level_screen) {
+		screen_out->append(prefix, prefix_len);
+		screen_out->append(text, len);
+		screen_out->push_back('\n');
 	}
 }
 
-void endlogging()
+// output_lock must be held; 'force': also a compressed block that is not
+// complete yet
+static void write_file(const std::string & file_out, const bool force)
 {
-	closelog();
+	if (log_ct != CT_NONE) {
+		// small gzip members or zstd frames compress badly
+		if (lf_pending.empty())
+			lf_pending_since = get_ts_ms();
+
+		lf_pending += file_out;
+
+		if (lf_pending.empty() || (force == false && lf_pending.size() < LOG_BLOCK_SIZE && get_ts_ms() - lf_pending_since < LOG_BLOCK_MAX_AGE_MS))
+			return;
+	}
+	else if (file_out.empty()) {
+		return;
+	}
+
+	if (lfd != -1 || open_logfile()) {
+		std::string data = compress_block(log_ct, log_ct != CT_NONE ? lf_pending : file_out);
+
+		lf_pending.clear();
+
+		const char *p   = data.c_str();
+		size_t      len = data.size();
+
+		while(len > 0) {
+			ssize_t rc = write(lfd, p, len);
+
+			if (rc == -1 && errno == EINTR)
+				continue;
+
+			if (rc <= 0) {
+				fprintf(stderr, "Cannot write to log-file %s: %s\n", logfile.c_str(), strerror(errno));
+				break;
+			}
+
+			p   += rc;
+			len -= rc;
+		}
+
+		lf_size += data.size();
+
+		if (rotate_size && lf_size >= rotate_size)
+			rotate_logfile();
+	}
+}
+
+// output_lock must be held
+static void write_out(const std::string & file_out, const std::string & screen_out, const bool force)
+{
+	write_file(file_out, force);
+
+	if (screen_out.empty() == false) {
+		fwrite(screen_out.c_str(), 1, screen_out.size(), stdout);
+		fflush(stdout);
+	}
+}
+
+static void write_direct(const uint64_t ts, const int tid, const log_level_t ll, const char *const text, const size_t len)
+{
+	std::unique_lock<std::mutex> lck(output_lock);
+
+	std::string file_out;
+	std::string screen_out;
+
+	format_line(ts, tid, ll, text, len, &file_out, &screen_out);
+
+	// no flusher to write it later
+	write_out(file_out, screen_out, true);
+}
+
+static void copy_in(log_buffer_t *const b, const uint64_t pos, const void *const src, const size_t n)
+{
+	size_t offset = pos & (LOG_BUFFER_SIZE - 1);
+	size_t first  = std::min(n, size_t(LOG_BUFFER_SIZE) - offset);
+
+	memcpy(&b->data[offset], src, first);
+	memcpy(&b->data[0], reinterpret_cast<const char *>(src) + first, n - first);
+}
+
+static void copy_out(const log_buffer_t *const b, const uint64_t pos, void *const dest, const size_t n)
+{
+	size_t offset = pos & (LOG_BUFFER_SIZE - 1);
+	size_t first  = std::min(n, size_t(LOG_BUFFER_SIZE) - offset);
+
+	memcpy(dest, &b->data[offset], first);
+	memcpy(reinterpret_cast<char *>(dest) + first, &b->data[0], n - first);
+}
+
+static bool push(log_buffer_t *const b, const record_header_t & h, const char *const text)
+{
+	uint64_t head = b->head.load(std::memory_order_relaxed);
+	uint64_t tail = b->tail.load(std::memory_order_acquire);
+	size_t   need = sizeof h + h.len;
+
+	if (LOG_BUFFER_SIZE - (head - tail) < need)
+		return false;
+
+	copy_in(b, head, &h, sizeof h);
+	copy_in(b, head + sizeof h, text, h.len);
+
+	b->head.store(head + need, std::memory_order_release);
+
+	return true;
+}
+
+static void drain(log_buffer_t *const b, std::vector<record_t> *const out)
+{
+	uint64_t head = b->head.load(std::memory_order_acquire);
+	uint64_t tail = b->tail.load(std::memory_order_relaxed);
+
+	while(tail < head) {
+		record_t r;
+		copy_out(b, tail, &r.h, sizeof r.h);
+
+		r.tid = b->tid;
+		r.text.resize(r.h.len);
+		copy_out(b, tail + sizeof r.h, r.text.data(), r.h.len);
+
+		tail += sizeof r.h + r.h.len;
+
+		out->push_back(std::move(r));
+	}
+
+	b->tail.store(tail, std::memory_order_release);
+}
+
+static log_buffer_t *get_thread_buffer()
+{
+	if (thread_buffer.b == nullptr) {
+		thread_buffer.b = new log_buffer_t;
+		thread_buffer.b->tid = gettid();
+
+		std::unique_lock<std::mutex> lck(buffers_lock);
+		buffers.push_back(thread_buffer.b);
+	}
+
+	return thread_buffer.b;
+}
+
+// only one thread at a time: the flusher, or the thread that stopped it.
+// 'force': also the compressed output that is pending
+static void flush_buffers(const bool force)
+{
+	std::vector<record_t> records;
+
+	{
+		std::unique_lock<std::mutex> lck(buffers_lock);
+
+		for(auto it = buffers.begin(); it != buffers.end();) {
+			bool orphaned = (*it)->orphaned;
 
-	free((void *)logfile);
-	logfile = nullptr;
+			drain(*it, &records);
+
+			if (orphaned) {
+				delete *it;
+				it = buffers.erase(it);
+			}
+			else {
+				it++;
+			}
+		}
+	}
+
+	std::sort(records.begin(), records.end(), [](const record_t & a, const record_t & b) { return a.h.seq < b.h.seq; });
+
+	// also without new lines: the pending block may have become too old
+	std::unique_lock<std::mutex> lck(output_lock);
+
+	std::string file_out;
+	std::string screen_out;
+
+	for(auto & r : records)
+		format_line(r.h.ts, r.tid, r.h.ll, r.text.c_str(), r.h.len, &file_out, &screen_out);
+
+	write_out(file_out, screen_out, force);
+}
+
+static void wake_flusher()
+{
+	{
+		std::unique_lock<std::mutex> lck(flusher_lock);
+		flusher_wake = true;
+	}
+
+	flusher_cv.notify_one();
+}
+
+static void flusher_thread()
+{
+	for(;;) {
+		std::unique_lock<std::mutex> lck(flusher_lock);
+
+		flusher_cv.wait_for(lck, std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS), [] { return flusher_stop || flusher_wake; });
+
+		bool stop = flusher_stop;
+		flusher_wake = false;
+
+		lck.unlock();
+
+		flush_buffers(false);
+
+		if (stop)
+			break;
+	}
 }
 
-void dolog(const log_level_t ll, const char *fmt, ...)
+static void stop_flusher()
 {
-	if (ll < log_level_file && ll < log_level_screen)
+	if (flusher == nullptr)
 		return;
 
-	if (!lfh && logfile) {
-		lfh = fopen(logfile, "a+");
-		if (!lfh) {
-			fprintf(stderr, "Cannot access log-file %s: %s\n", logfile, strerror(errno));
-			exit(1);
+	running = false;
+
+	{
+		std::unique_lock<std::mutex> lck(flusher_lock);
+		flusher_stop = true;
+	}
+
+	flusher_cv.notify_one();
+
+	flusher->join();
+	delete flusher;
+	flusher = nullptr;
+
+	// lines that were added while it was stopping, and what is pending
+	flush_buffers(true);
+}
+
+static void start_flusher()
+{
+	static bool at_exit_set = false;
+
+	if (at_exit_set == false) {
+		// also for exit() from error_exit()
+		atexit(stop_flusher);
+
+		at_exit_set = true;
+	}
+
+	flusher_stop = false;
+	flusher_wake = false;
+
+	running = true;
+
+	flusher = new std::thread(flusher_thread);
+}
+
+void setlog(const char *lf, const log_level_t ll_file, const log_level_t ll_screen)
+{
+	compression_t ct = compression_of(lf);
+
+	// what was logged before goes to the previous file
+	stop_flusher();
+
+	{
+		std::unique_lock<std::mutex> lck(output_lock);
+
+		if (lfd != -1) {
+			close(lfd);
+			lfd = -1;
 		}
 
-		if (fcntl(fileno(lfh), F_SETFD, FD_CLOEXEC) == -1) {
-			fprintf(stderr, "fcntl(FD_CLOEXEC): %s\n", strerror(errno));
+		logfile = lf;
+		log_ct  = ct;
+
+		if (open_logfile() == false)
 			exit(1);
-		}
+
+		log_level_file   = ll_file;
+		log_level_screen = ll_screen;
+		log_level_lowest = std::min(ll_file, ll_screen);
 	}
 
-	uint64_t now = get_ts_ms();
-	time_t t_now = now / 1000;
+	start_flusher();
+}
 
-	struct tm tm { 0 };
-	if (!localtime_r(&t_now, &tm))
-		fprintf(stderr, "localtime_r: %s\n", strerror(errno));
+void setlog(const char *lf, const std::string & ll_file, const std::string & ll_screen)
+{
+	setlog(lf, parse_ll(ll_file), parse_ll(ll_screen));
+}
 
-	char *ts_str = nullptr;
+void setlogrotate(const uint64_t max_size, const int n_keep)
+{
+	std::unique_lock<std::mutex> lck(output_lock);
+
+	rotate_size = max_size;
+	rotate_keep = n_keep;
+}
+
+void closelog()
+{
+	std::unique_lock<std::mutex> lck(output_lock);
 
-	const char *const ll_names[] = { "debug  ", "info   ", "notice ", "warning", "error  " };
+	write_file({ }, true);
 
-	asprintf(&ts_str, "%04d-%02d-%02d %02d:%02d:%02d.%03d [%d] %s ",
-			tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, int(now % 1000),
-			gettid(), ll_names[ll]);
+	// re-opened when needed
+	if (lfd != -1) {
+		close(lfd);
+		lfd = -1;
+	}
+}
 
-	char *str = nullptr;
+void endlogging()
+{
+	stop_flusher();
+
+	closelog();
+
+	std::unique_lock<std::mutex> lck(output_lock);
+	logfile.clear();
+}
+
+void dolog_real(const log_level_t ll, const char *fmt, ...)
+{
+	char  buffer[4096];
+	char *text = buffer;
 
 	va_list ap;
 	va_start(ap, fmt);
-	(void)vasprintf(&str, fmt, ap);
+	va_list ap_copy;
+	va_copy(ap_copy, ap);
+	int n = vsnprintf(buffer, sizeof buffer, fmt, ap);
 	va_end(ap);
 
-	if (ll >= log_level_file && lfh) {
-		fprintf(lfh, "%s%s\n", ts_str, str);
-		fflush(lfh);
-	}
+	// rare: only then the heap
+	if (n >= int(sizeof buffer) && vasprintf(&text, fmt, ap_copy) == -1)
+		text = nullptr;
+
+	va_end(ap_copy);
+
+	if (n < 0 || text == nullptr)
+		return;
 
-	if (ll >= log_level_screen)
-		printf("%s%s\n", ts_str, str);
+	uint64_t now = get_ts_ms();
+
+	record_header_t h { 0, now, uint32_t(std::min(n, LOG_LINE_MAX)), ll };
+
+	if (running == false)
+		write_direct(now, gettid(), ll, text, h.len);
+	else {
+		log_buffer_t *b = get_thread_buffer();
+
+		h.seq = seq++;
+
+		while(push(b, h, text) == false) {
+			// full: wait for the flusher
+			wake_flusher();
+
+			if (running == false) {
+				write_direct(now, b->tid, ll, text, h.len);
+				break;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		if (ll >= error || b->head - b->tail > LOG_BUFFER_SIZE / 2)
+			wake_flusher();
+	}
 
-	free(str);
-	free(ts_str);
+	if (text != buffer)
+		free(text);
 }
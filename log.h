@@ -1,13 +1,25 @@
 // (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
 // Released under MIT license
 
+#pragma once
+
+#include <stdint.h>
 #include <string>
 
 
 typedef enum { debug, info, notice, warning, error } log_level_t;
 
+// lowest of the file- and screen log-levels
+extern log_level_t log_level_lowest;
+
+// 'lf' ending in ".gz" or ".zst" is written compressed
 void setlog(const char *lf, const log_level_t ll_file, const log_level_t ll_screen);
 void setlog(const char *lf, const std::string & ll_file, const std::string & ll_screen);
+// 'max_size' in bytes, 0 for no rotation; 'n_keep' older files are kept
+void setlogrotate(const uint64_t max_size, const int n_keep);
 void closelog();
 void endlogging();
-void dolog(const log_level_t ll, const char *fmt, ...);
+void dolog_real(const log_level_t ll, const char *fmt, ...);
+
+// the arguments are not evaluated when nothing is logged at this level
+#define dolog(ll, ...) do { if ((ll) >= log_level_lowest) dolog_real((ll), __VA_ARGS__); } while(0)
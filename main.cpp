@@ -3,194 +3,87 @@
 
 #include <algorithm>
 #include <atomic>
+#include <deque>
+#include <errno.h>
+#include <functional>
+#include <inttypes.h>
 #include <libconfig.h++>
 #include <map>
 #include <mutex>
 #include <optional>
+#include <poll.h>
 #include <random>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <string.h>
 #include <thread>
 #include <tuple>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include <sys/resource.h>
 #include <sys/time.h>
 
-#include "Glicko2/glicko/rating.hpp"
-
+#include "archive.h"
+#include "board.h"
+#include "controller.h"
 #include "color.h"
+#include "engine.h"
 #include "error.h"
 #include "gtp.h"
+#include "journal.h"
+#include "latency.h"
+#include "histogram.h"
 #include "log.h"
+#include "metrics.h"
+#include "net.h"
+#include "placement.h"
+#include "pool.h"
+#include "proc.h"
 #include "queue.h"
+#include "ratings.h"
+#include "reactor.h"
+#include "runner.h"
+#include "scheduler.h"
+#include "sprt.h"
 #include "sgf.h"
 #include "str.h"
 #include "time.h"
-
-std::mutex game_file_lock;
+#include "writer.h"
 
 std::atomic_bool stop_flag { false };
+std::atomic_bool ratings_requested { false };  // SIGUSR1
 
 typedef enum { RR_OK, RR_ERROR, RR_TIMEOUT } run_result_t;
 
-auto produce_seed()
-{
-	std::vector<unsigned int> random_data(std::mt19937::state_size);
-
-	std::random_device source;
-	std::generate(std::begin(random_data), std::end(random_data), [&](){return source();});
-
-	return std::seed_seq(std::begin(random_data), std::end(random_data));
-}
-
-thread_local auto mt_seed = produce_seed();
-thread_local std::mt19937_64 gen { mt_seed };
-
-bool seed_board_randomly(GtpEngine *const inst1, GtpEngine *const inst2, GtpEngine *const scorer, const int dim, const int n_random_stones, std::vector<std::string> *const sgf)
-{
-	enum { SR_OK, SR_RETRY, SR_FAIL } seed_result = SR_FAIL;
-
-	const int dimsq  = dim * dim;
-
-	std::vector<std::string> sgf_temp;
-
-        std::uniform_int_distribution<> rng(0, dimsq - 1);
-
-	do {
-		bool     *in_use = new bool[dimsq]();
-
-		sgf_temp.clear();
-
-		seed_result = SR_OK;
-
-		for(int i=0; i<n_random_stones * 2; i++) {
-			int v = 0;
-
-			do {
-				v = rng(gen);
-			}
-			while(in_use[v]);
-
-			in_use[v] = true;
-
-			color_t c = i & 1 ? C_WHITE : C_BLACK;
-
-			const int x = v % dim;
-			const int y = v / dim;
-
-			char x_gtp = 'A' + x;
-
-			if (x_gtp >= 'I')
-				x_gtp++;
-
-			std::string vertex = myformat("%c%d", x_gtp, y + 1);
-
-			if (!inst1->play(c, vertex)) {
-				seed_result = SR_FAIL;
-				break;
-			}
-
-			if (!inst2->play(c, vertex)) {
-				seed_result = SR_FAIL;
-				break;
-			}
-
-			// assuming that the scorer is always right
-			if (!scorer->play(c, vertex)) {
-				seed_result = i > 1 ? SR_RETRY : SR_FAIL;
-				break;
-			}
-
-			std::string move_str = myformat("%c%c", 'a' + x, 'a' + y);
-
-			if (c == C_BLACK)
-				sgf_temp.push_back(myformat("B[%s]", move_str.c_str()));
-			else
-				sgf_temp.push_back(myformat("W[%s]", move_str.c_str()));
-		}
-
-		delete [] in_use;
-
-		if (seed_result == SR_FAIL)
-			dolog(warning, "Seeding failed");
-		else if (seed_result == SR_RETRY)
-			dolog(warning, "Seeding failed - retrying");
-	}
-	while(seed_result == SR_RETRY);
-
-	if (seed_result == SR_OK) {
-		*sgf = sgf_temp;
-
-		return true;
-	}
-
-	return false;
-}
-
-bool seed_board_from_book(const std::vector<book_entry_t> *const book_entries, GtpEngine *const inst1, GtpEngine *const inst2, GtpEngine *const scorer, std::vector<std::string> *const sgf)
-{
-	size_t n_entries = book_entries->size();
-	size_t entry_idx = rand() % n_entries;
-
-	const auto & book_entry = book_entries->at(entry_idx);
-
-	scorer->boardsize(book_entry.dim);
-	inst1->boardsize(book_entry.dim);
-	inst2->boardsize(book_entry.dim);
-
-	for(auto & e : book_entry.moves) {
-		const color_t c = std::get<0>(e);
-		const int     x = std::get<1>(e);
-		const int     y = std::get<2>(e);
-
-		char x_gtp = 'A' + x;
-
-		if (x_gtp >= 'I')
-			x_gtp++;
-
-		std::string vertex = myformat("%c%d", x_gtp, y + 1);
-
-		if (!inst1->play(c, vertex))
-			return false;
-
-		if (!inst2->play(c, vertex))
-			return false;
-
-		// assuming that the scorer is always right
-		if (!scorer->play(c, vertex))
-			return false;
-
-		std::string move_str = myformat("%c%c", 'a' + x, 'a' + y);
-
-		if (c == C_BLACK)
-			sgf->push_back(myformat("B[%s]", move_str.c_str()));
-		else
-			sgf->push_back(myformat("W[%s]", move_str.c_str()));
-	}
-
-	return true;
-}
+typedef enum { PM_OK, PM_ILLEGAL, PM_ENGINE_FAILED, PM_TIMEOUT } play_move_result_t;
 
 typedef struct _stats_t_ {
 	std::atomic_int ok    { 0 };
 	std::atomic_int error { 0 };
-	std::atomic_uint64_t ok_took { 0 };
+	std::atomic_int timeout { 0 };  // an engine hung
+	std::atomic_uint64_t ok_took { 0 };  // nanoseconds
+	std::atomic_uint64_t play_ns  { 0 };  // duration of play()
+	std::atomic_uint64_t think_ns { 0 };  // of which the engines were computing
+	std::atomic_uint64_t n_played { 0 };  // games finished in this run (not those of the journal)
 
 	std::mutex errors_lock;
 	std::map<std::string, int> errors;
 	std::map<std::string, std::map<std::string, int> > results;
 
+	Ratings *ratings { nullptr };  // of the tournament, not of a worker
+
 	_stats_t_() {
 	}
 } stats_t;
 
-void insert_result(stats_t *const s, const std::string & name, const std::string & key)
+void insert_result(stats_t *const s, const std::string & name, const std::string & key, const int n = 1)
 {
 	std::unique_lock<std::mutex> lck(s->errors_lock);
 
 	if (auto it = s->results.find(name); it == s->results.end()) {
-		std::map<std::string, int> entry { std::pair<std::string, int>(key, 1) };
+		std::map<std::string, int> entry { std::pair<std::string, int>(key, n) };
 
 		s->results.insert({ name, entry });
 	}
@@ -198,9 +91,9 @@ void insert_result(stats_t *const s, const std::string & name, const std::string
 		auto it2 = it->second.find(key);
 
 		if (it2 == it->second.end())
-			it->second.insert(std::pair<std::string, int>(key, 1));
+			it->second.insert(std::pair<std::string, int>(key, n));
 		else
-			it2->second++;
+			it2->second += n;
 	}
 }
 
@@ -214,658 +107,2721 @@ typedef struct {
 	double byo_yomi_time;
 	int    byo_yomi_stones;
 	bool   constant_time;
+	bool   cpu_time;       // charge the cpu time of the engine instead of the wall-clock time
+	double cpu_time_wall_factor;  // ...but at least the wall-clock time divided by this
+	double genmove_grace;  // a genmove may take this much longer than the time left before the engine is killed
 } time_control_t;
 
 typedef enum { ts_main_time, ts_byo_yomi_time } time_state_t;
 
-// result, vector-of-sgf-moves
-std::tuple<std::optional<std::string>, std::vector<std::string>, run_result_t> play(GtpEngine *const pb, GtpEngine *const pw, const int dim, GtpEngine *const scorer, const time_control_t & tc, const int n_random_stones, const std::vector<book_entry_t> *const book_entries, stats_t *const s)
+// list_commands is only asked once per engine
+void share_engine_details(engine_parameters_t *const ep, GtpEngine *const e)
 {
-	std::vector<std::string> sgf;
+	std::unique_lock<std::mutex> lck(ep->lock);
 
-	if (pb->clearboard() == false || pw->clearboard() == false || scorer->clearboard() == false) {
-		dolog(error, "\"clear_board\" not accepted");
+	if (ep->commands.has_value()) {
+		e->set_commands(ep->commands.value());
 
-		return { { }, { }, RR_ERROR };
+		return;
 	}
 
-	scorer->boardsize(dim);
-	pb->boardsize(dim);
-	pw->boardsize(dim);
+	lck.unlock();
 
-	GtpEngine *ge[] = { pb, pw };
+	auto commands = e->get_commands();
 
-	bool use_time_left[] = { false, false };
+	lck.lock();
 
-	if (pb->has_command("time_settings"))
-		pb->time_settings(tc.main_time, tc.byo_yomi_time, tc.byo_yomi_stones);
+	ep->commands = commands;
+}
 
-	use_time_left[C_BLACK] = tc.constant_time == false && pb->has_command("time_left");
+typedef struct {
+	std::optional<std::string> result;  // nothing when the game failed
+	std::vector<std::string>   sgf;
+	run_result_t               rr;
+	std::string                name1, name2;  // black, white
+	uint64_t                   took;     // nanoseconds
+	time_t                     start_t;
+	int                        opening      { -1 };  // book entry
+	uint64_t                   time_used[2] { 0, 0 };  // nanoseconds, black and white
+} game_t;
+
+// a game on this host, as a state machine: every step sends commands to the
+// engines (and the scorer) and returns. The reactor thread that receives the
+// last of their responses (or sees a deadline pass) posts the next step to
+// the game threads, so no thread waits for an engine and the number of
+// threads does not depend on the number of games that are played at the
+// same time.
+// The engines come from the pool and return to it, which can mean starting
+// or stopping processes: that is done by the threads of 'starter' (the
+// constructor should be invoked from one), so that it does not hold up the
+// moves of other games. start() sends the first commands. When the game is
+// over, 'finished' is invoked (from a thread of 'starter') and the object
+// deletes itself.
+// games 2n and 2n+1 (the same engines, colours reversed) get the same opening
+class Game
+{
+private:
+	typedef enum { S_SETUP, S_OPENING, S_CLEAR, S_GENMOVE, S_PLAY, S_SCORE, S_ENGINE_SCORES } state_t;
+
+	// a command of the current step
+	typedef struct {
+		GtpEngine                                *e;
+		std::optional<std::vector<std::string> >  response;
+		bool                                      timed_out;
+		uint64_t                                  ts;  // get_ts_ns() when it was answered
+	} command_t;
+
+	engine_parameters_t       *const p1;  // black
+	engine_parameters_t       *const p2;  // white
+	const engine_parameters_t *const ps;
+	const time_control_t             tc;
+	const double                     komi;
+	const int                        n_random_stones;
+	stats_t                   *const s;
+	EnginePool                *const pool;
+	ConcurrencyController     *const cc;
+	engine_latency_t                *latency[2];
+	TaskRunner                *const runner;
+	TaskRunner                *const starter;
+	const std::function<void(const game_t &)> finished;
+
+	GtpEngine   *pb     { nullptr };
+	GtpEngine   *pw     { nullptr };
+	GtpEngine   *scorer { nullptr };  // can be nullptr when the built-in board supports the board size
+	GtpEngine   *ge[2]  { nullptr, nullptr };
+	std::string  name1, name2;
+
+	uint64_t     start_ts;
+	time_t       start_t;
+
+	state_t      state { S_SETUP };
+
+	// the responses are stored by the reactor threads
+	std::mutex             lock;
+	std::vector<command_t> commands;
+	int                    n_pending { 0 };
+
+	int                  dim        { 0 };
+	GoBoard             *board      { nullptr };
+	std::mt19937_64      pair_gen;
+	const book_entry_t  *book_entry { nullptr };
+	int                  opening    { -1 };  // index of the book entry
+
+	// the opening: the next move of the book entry or random stone
+	size_t                   opening_move { 0 };
+	std::vector<bool>        in_use;    // random stones
+	std::vector<std::string> sgf_temp;  // ...as long as they may be placed again
+
+	// play_everywhere() in progress
+	color_t                  play_color { C_BLACK };
+	std::string              play_vertex;
+	bool                     illegal { false };
+	bool                     play_to_scorer { false };
+
+	std::vector<std::string>   sgf;
+	std::optional<std::string> result;
+	run_result_t               rr { RR_OK };
+
+	bool         use_time_left[2] { false, false };
+
+	// the part of a genmove that is spent in pipes and such, not thinking
+	uint64_t     rtt[2]           { 0, 0 };
+
+	// all in nanoseconds
+	uint64_t     time_total[2]    { 0, 0 };  // charged
+	uint64_t     think_total      { 0 };     // wall-clock
+	int          n_played[2]      { 0, 0 };
+
+	time_state_t ts[2]            { ts_main_time, ts_main_time };
+	int64_t      time_left[2]     { 0, 0 };
+	int          stones_to_do[2]  { 0, 0 };
+
+	color_t      color            { C_BLACK };
+
+	bool         pass[2]          { false, false };
+
+	// the genmove in progress
+	size_t                  genmove_cmd   { 0 };
+	std::optional<uint64_t> start_cpu;
+	double                  budget        { 0. };
+	int                     deadline_ms   { 0 };
+	uint64_t                genmove_ts    { 0 };
+	std::string             move;
+
+	uint64_t                play_start_ts { 0 };
+
+	void   begin();
+	size_t send(GtpEngine *const e, const std::string & cmd, const std::optional<int> timeout_ms = { });
+	void   end_sends();
+	void   completed(const size_t nr, std::optional<std::vector<std::string> > response, const bool timed_out);
+	void   step();
+
+	void   play_everywhere(const std::vector<GtpEngine *> & engines, const color_t c, const std::string & vertex);
+	play_move_result_t play_result(GtpEngine **const hung);
+
+	void   hung(GtpEngine *const e, const std::string & what);
+	void   fail();
+
+	void   setup_done();
+	void   next_opening_move();
+	void   opening_move_done();
+	void   clear_done();
+	void   seeding_failed(GtpEngine *const seed_hung);
+	void   start_moves();
+	void   next_genmove();
+	void   genmove_done();
+	void   play_done();
+	void   end_of_moves();
+	void   score_done();
+	void   scored();
+	void   engine_scores_done();
+	void   complete();
+	void   finish();
+
+public:
+	Game(const std::string & meta_str, engine_parameters_t *const p1, engine_parameters_t *const p2, const engine_parameters_t *const ps, const int dim_in, stats_t *const s, const time_control_t & tc, const double komi, const int n_random_stones, const std::vector<book_entry_t> *const book_entries, EnginePool *const pool, const Placement *const placement, const int slot, ConcurrencyController *const cc, const int nr, engine_latency_t *const latency_in[], TaskRunner *const runner, TaskRunner *const starter, const std::function<void(const game_t &)> & finished);
+
+	void start();
+};
+
+Game::Game(const std::string & meta_str, engine_parameters_t *const p1, engine_parameters_t *const p2, const engine_parameters_t *const ps, const int dim_in, stats_t *const s, const time_control_t & tc, const double komi, const int n_random_stones, const std::vector<book_entry_t> *const book_entries, EnginePool *const pool, const Placement *const placement, const int slot, ConcurrencyController *const cc, const int nr, engine_latency_t *const latency_in[], TaskRunner *const runner, TaskRunner *const starter, const std::function<void(const game_t &)> & finished) :
+	p1(p1), p2(p2), ps(ps),
+	tc(tc),
+	komi(komi),
+	n_random_stones(n_random_stones),
+	s(s),
+	pool(pool),
+	cc(cc),
+	latency { latency_in[C_BLACK], latency_in[C_WHITE] },
+	runner(runner),
+	starter(starter),
+	finished(finished)
+{
+	scorer = ps ? pool->get(ps) : nullptr;
 
-	if (pw->has_command("time_settings"))
-		pw->time_settings(tc.main_time, tc.byo_yomi_time, tc.byo_yomi_stones);
+	pb    = pool->get(p1);
+	name1 = pb->getname();
+	share_engine_details(p1, pb);
 
-	use_time_left[C_WHITE] = tc.constant_time == false && pw->has_command("time_left");
+	pw    = pool->get(p2);
+	name2 = pw->getname();
+	share_engine_details(p2, pw);
 
-	if (book_entries->empty() == false) {
-		// TODO: get from book
-		if (!seed_board_from_book(book_entries, pb, pw, scorer, &sgf)) {
-			dolog(error, "Failed to seed board from book for %s versus %s", pb->getname().c_str(), pw->getname().c_str());
+	ge[C_BLACK] = pb;
+	ge[C_WHITE] = pw;
 
-			return { { }, { }, RR_ERROR };
-		}
+	// pool engines may have played on an other slot before
+	if (placement) {
+		placement->apply(slot, pb->get_pid());
+		placement->apply(slot, pw->get_pid());
+
+		if (scorer)
+			placement->apply(slot, scorer->get_pid());
+
+		dolog(info, "%s%s versus %s started on slot %d (%s)", meta_str.c_str(), name1.c_str(), name2.c_str(), slot, placement->describe(slot).c_str());
 	}
 	else {
-		if (!seed_board_randomly(pb, pw, scorer, dim, n_random_stones, &sgf)) {
-			dolog(error, "Failed to seed board randomly for %s versus %s", pb->getname().c_str(), pw->getname().c_str());
+		dolog(info, "%s%s versus %s started", meta_str.c_str(), name1.c_str(), name2.c_str());
+	}
 
-			return { { }, { }, RR_ERROR };
-		}
+	start_ts = get_ts_ns();
+
+	start_t  = time(nullptr);
+
+	if (cc) {
+		cc->add_pid(pb->get_pid());
+		cc->add_pid(pw->get_pid());
 	}
 
-	uint64_t time_total[] = { 0, 0 };
-	int      n_played[]   = { 0, 0 };
+	pb->set_command_latency(&latency[C_BLACK]->command);
+	pw->set_command_latency(&latency[C_WHITE]->command);
 
-	time_state_t ts[]           = { ts_main_time, ts_main_time };
-	int          time_left[]    = { int(tc.main_time * 1000), int(tc.main_time * 1000) };
-	int          stones_to_do[] = { 0, 0 };
+	// also on a worker or after a restart: only depends on the pair
+	std::seed_seq pair_seed { nr / 2 };
+	pair_gen.seed(pair_seed);
 
-	color_t  color  = C_BLACK;
+	if (book_entries->empty() == false) {
+		opening    = pair_gen() % book_entries->size();
+		book_entry = &book_entries->at(opening);
+	}
 
-	std::optional<std::string> result;
+	dim = book_entry ? book_entry->dim : dim_in;
 
-	run_result_t rr = RR_OK;
+	// measured once per process, before the game starts
+	rtt[C_BLACK] = pb->get_rtt_ns();
+	rtt[C_WHITE] = pw->get_rtt_ns();
+}
 
-	insert_result(s, pb->getname(), "black games played");
+// nothing is sent to the engines before this
+void Game::begin()
+{
+	std::unique_lock<std::mutex> lck(lock);
 
-	insert_result(s, pw->getname(), "white games played");
+	commands.clear();
 
-	bool pass[2] { false, false };
+	// keeps the step from being posted while commands are still being sent
+	n_pending = 1;
+}
 
-	for(;;) {
-		std::string move;
+// returns the index in 'commands'
+size_t Game::send(GtpEngine *const e, const std::string & cmd, const std::optional<int> timeout_ms)
+{
+	size_t nr = 0;
 
-		color_t opponent_color = color == C_BLACK ? C_WHITE : C_BLACK;
+	{
+		std::unique_lock<std::mutex> lck(lock);
 
-		if (ts[color] == ts_main_time)
-			dolog(debug, "Player %s has %.3f seconds/, black/white pass: %d/%d", color_name(color).c_str(), time_left[color] / 1000., pass[C_BLACK], pass[C_WHITE]);
-		else
-			dolog(debug, "Player %s has %.3f seconds/%d stones left, black/white pass: %d/%d", color_name(color).c_str(), time_left[color] / 1000., stones_to_do[color], pass[C_BLACK], pass[C_WHITE]);
+		nr = commands.size();
 
-		if (use_time_left[color] && ge[color]->time_left(color, time_left[color], ts[color] == ts_main_time ? 0 : stones_to_do[color]) == false) {
-			dolog(info, "%s (%s) did not respond to time_left", color_name(color).c_str(), ge[color]->getname().c_str());
-			result = "?";
-			rr = RR_ERROR;
-			break;
-		}
+		commands.push_back({ e, { }, false, 0 });
 
-		uint64_t start_ts = get_ts_ms();
-		auto     rc       = ge[color]->genmove(color);
-		uint64_t end_ts   = get_ts_ms();
+		n_pending++;
+	}
 
-		if (rc.has_value() == false) {
-			dolog(info, "%s (%s) did not return a move (%s)", color_name(color).c_str(), ge[color]->getname().c_str(), ge[color]->get_loghelper().c_str());
-			result = "?";
-			rr = RR_ERROR;
-			break;
-		}
+	if (e->send(cmd, timeout_ms, [this, nr](std::optional<std::vector<std::string> > response, const bool timed_out) { completed(nr, std::move(response), timed_out); }) == false)
+		completed(nr, { }, false);
 
-		uint64_t took = end_ts - start_ts;
+	return nr;
+}
 
-		if (tc.constant_time) {
-			if (took > uint64_t(tc.main_time * 1000))
-				time_left[color] = -1;
+// the game may continue in an other thread from here on: nothing of it may be used after this
+void Game::end_sends()
+{
+	std::unique_lock<std::mutex> lck(lock);
 
-			time_total[color] += took;
-		}
-		else {
-			time_total[color] += took;
-			time_left [color] -= took;
-
-			stones_to_do[color]--;
-
-			if (time_left[color] < 0) {
-				if (ts[color] == ts_main_time)
-					ts[color] = ts_byo_yomi_time;
-				else {
-					if (stones_to_do[color] != 0) {
-						dolog(info, "%s (%s) did not return enought byo yomi moves: %d left", color_name(color).c_str(), ge[color]->getname().c_str(), stones_to_do[color]);
-						result = "?";
-						rr = RR_ERROR;
-						break;
-					}
-				}
+	bool last = --n_pending == 0;
 
-				time_left[color]    = int(tc.byo_yomi_time * 1000);
-				stones_to_do[color] = tc.byo_yomi_stones;
-			}
-		}
+	lck.unlock();
 
-		n_played[color]++;
+	if (last)
+		runner->post([this] { step(); });
+}
 
-		move = rc.value();
+// usually invoked from a reactor thread
+void Game::completed(const size_t nr, std::optional<std::vector<std::string> > response, const bool timed_out)
+{
+	uint64_t now = get_ts_ns();
 
-		if (move != "resign")
-			ge[opponent_color]->play(color, move);
+	std::unique_lock<std::mutex> lck(lock);
 
-		move = str_tolower(move);
-		
-		// TODO: validate move, not only by scorer
+	command_t & c = commands.at(nr);
+	c.response  = std::move(response);
+	c.timed_out = timed_out;
+	c.ts        = now;
 
-		if (move == "resign") {
-			if (color == C_BLACK) {
-				result = "W+Resign";
-				insert_result(s, pb->getname(), "black resign");
-			}
-			else {
-				result = "B+Resign";
-				insert_result(s, pw->getname(), "white resign");
-			}
+	bool last = --n_pending == 0;
 
-			break;
-		}
-		else if (!scorer->play(color, move)) {
-			dolog(warning, "%s (%s) performed an illegal move (move %d, %s)", color_name(color).c_str(), ge[color]->getname().c_str(), n_played[color], ge[color]->get_loghelper().c_str());
+	lck.unlock();
 
-			if (color == C_BLACK) {
-				result = "W+Illegal";
-				insert_result(s, pb->getname(), "black illegal move");
-			}
-			else {
-				result = "B+Illegal";
-				insert_result(s, pw->getname(), "white illegal move");
-			}
+	if (last)
+		runner->post([this] { step(); });
+}
 
+// all commands of the current state were answered (or timed out)
+void Game::step()
+{
+	switch(state) {
+		case S_SETUP:
+			setup_done();
 			break;
-		}
-		else if (time_left[color] < 0) {
-			if (color == C_BLACK) {
-				result = "W+Time";
-				insert_result(s, pb->getname(), "black out of time");
-			}
-			else {
-				result = "B+Time";
-				insert_result(s, pw->getname(), "white out of time");
-			}
-
+		case S_OPENING:
+			opening_move_done();
 			break;
-		}
-		else if (move == "pass") {
-			bool end = false;
+		case S_CLEAR:
+			clear_done();
+			break;
+		case S_GENMOVE:
+			genmove_done();
+			break;
+		case S_PLAY:
+			play_done();
+			break;
+		case S_SCORE:
+			score_done();
+			break;
+		case S_ENGINE_SCORES:
+			engine_scores_done();
+			break;
+	}
+}
 
-			if (color == C_BLACK) {
-				end |= pass[C_BLACK];
-				pass[C_BLACK] = true;
+// the built-in board is leading, the external scorer (when used) is only
+// consulted when there's no board for this size or as a cross-check.
+// the engines and the scorer are sent the move at the same time, see
+// play_result() for the outcome.
+void Game::play_everywhere(const std::vector<GtpEngine *> & engines, const color_t c, const std::string & vertex)
+{
+	begin();
 
-				sgf.push_back("B[]");
-			}
-			else {
-				end |= pass[C_WHITE];
-				pass[C_WHITE] = true;
+	play_color     = c;
+	play_vertex    = vertex;
+	illegal        = board && board->play(c, vertex) == false;
+	play_to_scorer = scorer != nullptr && illegal == false;
 
-				sgf.push_back("W[]");
-			}
+	if (illegal == false) {
+		std::string cmd = myformat("play %c %s", c == C_WHITE ? 'w' : 'b', vertex.c_str());
 
-			if (end)
-				break;
-		}
-		else {
-			pass[C_BLACK] = pass[C_WHITE] = false;
+		if (scorer)
+			send(scorer, cmd);
 
-			// gtp to sgf
-			char column = move.at(0);
-			if (column >= 'j')
-				column--;
+		for(auto & e : engines)
+			send(e, cmd);
+	}
 
-			int row_str = atoi(move.substr(1).c_str());
-			char row = 'a' + row_str - 1;
+	end_sends();
+}
 
-			std::string move_str = myformat("%c%c", column, row);
+// PM_TIMEOUT: 'hung' is set to the engine that did not respond in time.
+play_move_result_t Game::play_result(GtpEngine **const hung)
+{
+	if (illegal)
+		return PM_ILLEGAL;
 
-			if (color == C_BLACK)
-				sgf.push_back(myformat("B[%s]", move_str.c_str()));
-			else
-				sgf.push_back(myformat("W[%s]", move_str.c_str()));
-		}
+	play_move_result_t rc = PM_OK;
 
-		color = opponent_color;
-	}
+	size_t first = 0;
 
-	dolog(info, "Black (%s) used %.3fs per move (%.3f total), %d moves, white (%s) used %.3fs per move (%.3f total), %d moves",
-			pb->getname().c_str(), time_total[C_BLACK] / 1000. / n_played[C_BLACK], time_total[C_BLACK] / 1000., n_played[C_BLACK],
-			pw->getname().c_str(), time_total[C_WHITE] / 1000. / n_played[C_WHITE], time_total[C_WHITE] / 1000., n_played[C_WHITE]);
+	if (play_to_scorer && commands.at(0).response.has_value() == false) {
+		first = 1;
 
-	if (result.has_value() == false)
-		result = scorer->getscore();
+		if (commands.at(0).timed_out) {
+			dolog(warning, "Scorer did not respond to %s for %s in time", play_vertex.c_str(), color_name(play_color).c_str());
 
-	if (rr == RR_OK) {
-		auto b_result = pb->getscore();
-		auto w_result = pw->getscore();
+			scorer->kill();
 
-		dolog(info, "Result according to black: %s, according to white: %s, scorer: %s",
-				b_result.has_value() ? b_result.value().c_str() : "-",
-				w_result.has_value() ? w_result.value().c_str() : "-",
-				result.value().c_str());
+			if (board == nullptr)
+				rc = PM_ENGINE_FAILED;
+		}
+		else if (board)
+			dolog(warning, "Scorer rejected %s for %s while the built-in board accepted it", play_vertex.c_str(), color_name(play_color).c_str());
+		else
+			rc = PM_ILLEGAL;
+	}
+	else if (play_to_scorer) {
+		first = 1;
 	}
 
-	return { result, sgf, rr };
-}
+	// all responses were collected, also after a failure
+	for(size_t i=first; i<commands.size(); i++) {
+		command_t & c = commands.at(i);
 
-typedef struct {
-	std::string command, directory, alt_name;
-	std::string name;
-	bool target;
+		if (c.response.has_value())
+			continue;
+
+		if (c.timed_out && (rc == PM_OK || rc == PM_ENGINE_FAILED)) {
+			rc    = PM_TIMEOUT;
+			*hung = c.e;
+		}
+		else if (c.timed_out) {  // the move decided the game already, it cannot be re-used
+			c.e->kill();
+		}
+		else if (rc == PM_OK) {
+			rc = PM_ENGINE_FAILED;
+		}
+	}
 
-	std::mutex lock;
-	Glicko::Rating rating;
-} engine_parameters_t;
+	return rc;
+}
 
-void play_game(const std::string & meta_str, engine_parameters_t *const p1, engine_parameters_t *const p2, const engine_parameters_t *const ps, const int dim, const std::string & pgn_file, const std::string & sgf_file, stats_t *const s, const time_control_t & tc, const double komi, const int n_random_stones, const std::vector<book_entry_t> *const book_entries)
+// a command that does not finish in time: the engine is killed and loses on time
+void Game::hung(GtpEngine *const e, const std::string & what)
 {
-	GtpEngine *scorer = new GtpEngine(ps->command, ps->directory, "");
+	color_t c = e == pb ? C_BLACK : C_WHITE;
 
-	GtpEngine *inst1 = new GtpEngine(p1->command, p1->directory, p1->alt_name);
-	std::string name1 = inst1->getname();
-	p1->name = name1;
+	dolog(warning, "%s (%s) did not respond to %s in time", color_name(c).c_str(), e->getname().c_str(), what.c_str());
 
-	inst1->setkomi(komi);
+	e->kill();
+
+	if (c == C_BLACK) {
+		result = "W+Time";
+		insert_result(s, pb->getname(), "black hung");
+	}
+	else {
+		result = "B+Time";
+		insert_result(s, pw->getname(), "white hung");
+	}
 
-	GtpEngine *inst2 = new GtpEngine(p2->command, p2->directory, p2->alt_name);
-	std::string name2 = inst2->getname();
-	p2->name = name2;
+	rr = RR_TIMEOUT;
+}
 
-	inst2->setkomi(komi);
+// the game could not be played
+void Game::fail()
+{
+	delete board;
+	board = nullptr;
 
-	dolog(info, "%s%s versus %s started", meta_str.c_str(), name1.c_str(), name2.c_str());
+	result.reset();
+	sgf.clear();
+	rr = RR_ERROR;
 
-	uint64_t start_ts = get_ts_ms();
+	starter->post([this] { finish(); });
+}
 
-	time_t   start_t  = time(nullptr);
+void Game::start()
+{
+	play_start_ts = get_ts_ns();
 
-	auto resultrc = play(inst1, inst2, dim, scorer, tc, n_random_stones, book_entries, s);
-	if (std::get<0>(resultrc).has_value() == false) {
-		dolog(info, "Game between %s and %s failed", name1.c_str(), name2.c_str());
-		delete inst2;
-		delete inst1;
-		delete scorer;
-		return;
-	}
+	board = make_board(dim);
 
-	uint64_t end_ts = get_ts_ms();
-	uint64_t took = end_ts - start_ts;
+	if (board == nullptr && scorer == nullptr) {
+		dolog(error, "No scorer configured and board size %d is not supported by the built-in board", dim);
 
-	std::string result = str_tolower(std::get<0>(resultrc).value());
+		fail();
 
-	if (std::get<2>(resultrc) == RR_OK) {
-		s->ok++;
-		s->ok_took += took;
-	}
-	else if (std::get<2>(resultrc) == RR_ERROR) {
-		s->error++;
+		return;
 	}
 
-	std::string result_pgn = "1/2-1/2";
+	state = S_SETUP;
 
-	double p1_v = 0.0;
-	double p2_v = 0.0;
+	// all setup commands to all engines, the responses are collected by setup_done()
+	begin();
 
-	if (result.at(0) == 'b') {
-		result_pgn = "0-1";
+	for(auto c : { C_BLACK, C_WHITE }) {
+		send(ge[c], myformat("boardsize %d", dim));
+		// after "boardsize" the board is in an undefined state
+		send(ge[c], "clear_board");
+		send(ge[c], myformat("komi %f", komi));
 
-		p1_v = 1.0;
-		p2_v = 0.0;
+		if (ge[c]->has_command("time_settings"))
+			send(ge[c], myformat("time_settings %d %d %d", int(tc.main_time), int(tc.byo_yomi_time), tc.byo_yomi_stones));
 	}
-	else if (result.at(0) == 'w') {
-		result_pgn = "1-0";
 
-		p1_v = 0.0;
-		p2_v = 1.0;
+	if (scorer) {
+		send(scorer, myformat("boardsize %d", dim));
+		send(scorer, "clear_board");
+		send(scorer, myformat("komi %f", komi));
 	}
-	else if (result.at(0) == '?') {
-		// some error
-		std::string key = name1 + " versus " + name2;
 
-		s->errors_lock.lock();
+	end_sends();
+}
 
-		auto it = s->errors.find(key);
-		if (it == s->errors.end())
-			s->errors.insert({ key, 1 });
-		else
-			it->second++;
+void Game::setup_done()
+{
+	bool setup_ok          = true;
+	bool setup_timed_out[] = { false, false };
 
-		s->errors_lock.unlock();
-	}
-	else {
-		p1_v = 0.5;
-		p2_v = 0.5;
+	for(auto & c : commands) {
+		setup_ok &= c.response.has_value();
+
+		if (c.timed_out && (c.e == pb || c.e == pw))
+			setup_timed_out[c.e == pb ? C_BLACK : C_WHITE] = true;
 	}
 
-	if (result.at(0) != '?') {
-		{
-			std::unique_lock<std::mutex> lck(p1->lock);
-			p1->rating.Update(p2->rating, p1_v);
-			p1->rating.Apply();
-		}
+	if (setup_timed_out[C_BLACK] != setup_timed_out[C_WHITE])
+		hung(ge[setup_timed_out[C_BLACK] ? C_BLACK : C_WHITE], "the setup of the game");
+	else if (setup_ok == false) {
+		dolog(error, "Failed to setup the engines for %s versus %s", pb->getname().c_str(), pw->getname().c_str());
 
-		{
-			std::unique_lock<std::mutex> lck(p2->lock);
-			p2->rating.Update(p1->rating, p2_v);
-			p2->rating.Apply();
-		}
+		fail();
+
+		return;
 	}
 
-	game_file_lock.lock();
+	use_time_left[C_BLACK] = tc.constant_time == false && pb->has_command("time_left");
 
-	if (result.at(0) != '?') {
-		if (pgn_file.empty() == false) {
-			FILE *fh = fopen(pgn_file.c_str(), "a+");
-			if (fh) {
-				fprintf(fh, "[White \"%s\"]\n[Black \"%s\"]\n[Result \"%s\"]\n\n%s\n\n", name2.c_str(), name1.c_str(), result_pgn.c_str(), result_pgn.c_str());
-				fclose(fh);
-			}
-		}
-	}
+	use_time_left[C_WHITE] = tc.constant_time == false && pw->has_command("time_left");
 
-	if (sgf_file.empty() == false) {
-		FILE *fh = fopen(sgf_file.c_str(), "a+");
-		if (fh) {
-			tm *tm = localtime(&start_t);
+	// an engine hung during the setup
+	if (result.has_value()) {
+		end_of_moves();
 
-			fprintf(fh, "(;AP[Badank]DT[%04d-%02d-%02d]GM[1]KM[%f]SZ[%d]PW[%s]\nPB[%s]\nRE[%s]\nC[%s]RU[Tromp/Taylor]\n(", tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, komi, dim, name2.c_str(), name1.c_str(), str_toupper(result).c_str(), meta_str.c_str());
+		return;
+	}
 
-			for(const std::string & vertex : std::get<1>(resultrc))
-				fprintf(fh, ";%s", vertex.c_str());
+	if (book_entry == nullptr)
+		in_use.assign(dim * dim, false);
+
+	next_opening_move();
+}
 
-			if (std::get<2>(resultrc) != RR_OK)
-				fprintf(fh, ";C[%s]", result.c_str());
+// one move of the book entry or one random stone at a time
+void Game::next_opening_move()
+{
+	const size_t n = book_entry ? book_entry->moves.size() : size_t(n_random_stones * 2);
 
-			fprintf(fh, ";C[Initial %d black and %d white stones were placed randomly by Badank]", n_random_stones, n_random_stones);
+	if (opening_move == n) {
+		if (book_entry == nullptr)
+			sgf = sgf_temp;
 
-			fprintf(fh, ")\n)\n\n");
+		start_moves();
 
-			fclose(fh);
-		}
+		return;
 	}
-	game_file_lock.unlock();
 
-	{
-		std::unique_lock<std::mutex> lck1(p1->lock);
-		double r1 = p1->rating.Rating1();
-		lck1.unlock();
+	color_t c = C_BLACK;
+	int     x = 0;
+	int     y = 0;
 
-		std::unique_lock<std::mutex> lck2(p2->lock);
-		double r2 = p2->rating.Rating2();
-		lck2.unlock();
+	if (book_entry) {
+		auto & e = book_entry->moves.at(opening_move);
 
-		dolog(info, "%s (black; %f elo) versus %s (white; %f elo) result: %s, took: %fs", name1.c_str(), r1, name2.c_str(), r2, result.c_str(), (end_ts - start_ts) / 1000.0);
+		c = std::get<0>(e);
+		x = std::get<1>(e);
+		y = std::get<2>(e);
 	}
+	else {
+		std::uniform_int_distribution<> rng(0, dim * dim - 1);
+
+		int v = 0;
 
-	delete inst2;
+		do {
+			v = rng(pair_gen);
+		}
+		while(in_use[v]);
 
-	delete inst1;
+		in_use[v] = true;
 
-	delete scorer;
-}
+		c = opening_move & 1 ? C_WHITE : C_BLACK;
+		x = v % dim;
+		y = v / dim;
+	}
 
-typedef struct {
-	engine_parameters_t *p1, *p2;
-	int nr;
-} work_t;
+	char x_gtp = 'A' + x;
 
-void processing_thread(const engine_parameters_t *const scorer, const int dim, const std::string & pgn_file, const std::string & sgf_file, stats_t *const s, std::atomic_bool *const stop_flag, const time_control_t & tc, const double komi, const int n_random_stones, std::vector<book_entry_t> *const book_entries, Queue<work_t> *const q)
-{
-	for(;!*stop_flag;) {
-		work_t entry = q->pop();
+	if (x_gtp >= 'I')
+		x_gtp++;
 
-		if (entry.p1 == nullptr) {
-			dolog(info, "Work finished, terminating thread");
-			break;
-		}
+	std::string move_str = myformat("%c%c", 'a' + x, 'a' + y);
 
-		std::string meta = myformat("%d> ", entry.nr);
+	if (c == C_BLACK)
+		sgf_temp.push_back(myformat("B[%s]", move_str.c_str()));
+	else
+		sgf_temp.push_back(myformat("W[%s]", move_str.c_str()));
 
-		play_game(meta, entry.p1, entry.p2, scorer, dim, pgn_file, sgf_file, s, tc, komi, n_random_stones, book_entries);
-	}
+	state = S_OPENING;
+
+	// assuming that the referee is always right
+	play_everywhere({ pb, pw }, c, myformat("%c%d", x_gtp, y + 1));
 }
 
-void play_batch(const std::vector<engine_parameters_t *> & engines, const engine_parameters_t *const scorer, const int dim, const std::string & pgn_file, const std::string & sgf_file, const int concurrency, const int iterations, stats_t *const s, const time_control_t & tc, const double komi, const int n_random_stones, const std::string & sgf_book_path, std::atomic_bool *const stop_flag)
+void Game::opening_move_done()
 {
-	dolog(info, "Batch starting");
+	GtpEngine *seed_hung = nullptr;
 
-	size_t n = engines.size();
+	auto pm_rc = play_result(&seed_hung);
 
-	dolog(info, "Will play %ld games", n * (n - 1) * iterations);
+	if (pm_rc == PM_OK) {
+		if (book_entry)
+			sgf.push_back(sgf_temp.back());
 
-	std::vector<book_entry_t> book_entries;
+		opening_move++;
 
-	if (sgf_book_path.empty() == false)
-		load_sgf_opening_files(sgf_book_path, &book_entries);
+		next_opening_move();
 
-	Queue<work_t> q;
+		return;
+	}
 
-	std::vector<std::thread *> threads;
+	if (book_entry || pm_rc != PM_ILLEGAL || opening_move <= 1) {
+		seeding_failed(seed_hung);
 
-	for(int i=0; i<concurrency; i++) {
-		std::thread *th = new std::thread(processing_thread, scorer, dim, pgn_file, sgf_file, s, stop_flag, tc, komi, n_random_stones, &book_entries, &q);
-		threads.push_back(th);
+		return;
 	}
 
-	std::vector<engine_parameters_t *> targets;
+	dolog(warning, "Seeding failed - retrying");
 
-	for(auto & engine : engines) {
-		if (engine->target)
-			targets.push_back(engine);
-	}
+	// start over with an empty board everywhere
+	if (board)
+		board->clear();
 
-	if (targets.empty()) {
-		dolog(info, "everybody against everybody");
+	state = S_CLEAR;
 
-		int nr = 0;
+	begin();
 
-		for(int i=0; i<iterations; i++) {
-			for(size_t a=0; a<n; a++) {
-				for(size_t b=0; b<n; b++) {
-					if (*stop_flag) {
-						dolog(info, "Aborted batching");
-						goto abort_batching;
-					}
+	send(pb, "clear_board");
+	send(pw, "clear_board");
 
-					if (a == b)
-						continue;
+	if (scorer)
+		send(scorer, "clear_board");
 
-					q.push({ engines[a], engines[b], nr });
-					nr++;
+	end_sends();
+}
+
+void Game::clear_done()
+{
+	bool       ok        = true;
+	GtpEngine *seed_hung = nullptr;
+
+	for(auto & c : commands) {
+		ok &= c.response.has_value();
+
+		if (c.timed_out && c.e != scorer && seed_hung == nullptr)
+			seed_hung = c.e;
+	}
+
+	if (ok == false) {
+		seeding_failed(seed_hung);
+
+		return;
+	}
+
+	in_use.assign(dim * dim, false);
+	sgf_temp.clear();
+
+	opening_move = 0;
+
+	next_opening_move();
+}
+
+// 'seed_hung' is set when an engine did not respond in time
+void Game::seeding_failed(GtpEngine *const seed_hung)
+{
+	if (book_entry == nullptr)
+		dolog(warning, "Seeding failed");
+
+	if (seed_hung) {
+		hung(seed_hung, "a move of the opening");
+
+		end_of_moves();
+
+		return;
+	}
+
+	dolog(error, "Failed to seed board %s for %s versus %s", book_entry ? "from book" : "randomly", pb->getname().c_str(), pw->getname().c_str());
+
+	fail();
+}
+
+void Game::start_moves()
+{
+	time_left[C_BLACK] = time_left[C_WHITE] = int64_t(tc.main_time * 1e9);
+
+	color = C_BLACK;
+
+	next_genmove();
+}
+
+void Game::next_genmove()
+{
+	if (ts[color] == ts_main_time)
+		dolog(debug, "Player %s has %.3f seconds/, black/white pass: %d/%d", color_name(color).c_str(), time_left[color] / 1e9, pass[C_BLACK], pass[C_WHITE]);
+	else
+		dolog(debug, "Player %s has %.3f seconds/%d stones left, black/white pass: %d/%d", color_name(color).c_str(), time_left[color] / 1e9, stones_to_do[color], pass[C_BLACK], pass[C_WHITE]);
+
+	start_cpu.reset();
+
+	if (tc.cpu_time)
+		start_cpu = ge[color]->get_cpu_time_ns();
+
+	// the remaining time, byo yomi included; then the engine is considered to be hung
+	budget = tc.constant_time ? tc.main_time : std::max(time_left[color], int64_t(0)) / 1e9;
+
+	if (tc.constant_time == false && ts[color] == ts_main_time)
+		budget += tc.byo_yomi_time;
+
+	double allowed = budget;
+
+	if (tc.cpu_time)
+		allowed *= tc.cpu_time_wall_factor;
+
+	deadline_ms = int((allowed + tc.genmove_grace) * 1000 + rtt[color] / 1000000);
+
+	state = S_GENMOVE;
+
+	begin();
+
+	// sent together with the genmove, not waited for first: it is command 0
+	if (use_time_left[color])
+		send(ge[color], myformat("time_left %c %d %d", color == C_WHITE ? 'w' : 'b', int(time_left[color] / 1000000) / 1000, ts[color] == ts_main_time ? 0 : stones_to_do[color]));
+
+	genmove_ts  = get_ts_ns();
+	genmove_cmd = send(ge[color], myformat("genmove %c", color == C_WHITE ? 'w' : 'b'), deadline_ms);
+
+	end_sends();
+}
+
+void Game::genmove_done()
+{
+	const command_t & gm = commands.at(genmove_cmd);
+
+	uint64_t end_ts = gm.ts;
+
+	latency[color]->genmove[game_phase_of(sgf.size(), dim)].add((end_ts - genmove_ts) / 1000);
+
+	if (gm.timed_out) {
+		hung(ge[color], myformat("genmove (within %.3fs)", deadline_ms / 1000.));
+
+		end_of_moves();
+
+		return;
+	}
+
+	if (use_time_left[color] && commands.at(0).response.has_value() == false) {
+		if (commands.at(0).timed_out)
+			hung(ge[color], "time_left");
+		else {
+			dolog(info, "%s (%s) did not respond to time_left", color_name(color).c_str(), ge[color]->getname().c_str());
+			result = "?";
+			rr = RR_ERROR;
+		}
+
+		end_of_moves();
+
+		return;
+	}
+
+	if (gm.response.has_value() == false) {
+		dolog(info, "%s (%s) did not return a move (%s)", color_name(color).c_str(), ge[color]->getname().c_str(), ge[color]->get_loghelper().c_str());
+		result = "?";
+		rr = RR_ERROR;
+
+		end_of_moves();
+
+		return;
+	}
+
+	uint64_t took = end_ts - genmove_ts;
+
+	took = took > rtt[color] ? took - rtt[color] : 0;
+
+	think_total += took;
+
+	if (tc.cpu_time) {
+		auto end_cpu = ge[color]->get_cpu_time_ns();
+
+		if (start_cpu.has_value() && end_cpu.has_value()) {
+			uint64_t took_cpu = end_cpu.value() - start_cpu.value();
+
+			// so that an engine that waits for something (or sleeps) still gets charged
+			uint64_t wall_cap = uint64_t(took / tc.cpu_time_wall_factor);
+
+			dolog(debug, "%s took %.6fs wall-clock and %.6fs cpu time", color_name(color).c_str(), took / 1e9, took_cpu / 1e9);
+
+			took = std::max(took_cpu, wall_cap);
+		}
+		else {
+			dolog(warning, "Cannot retrieve cpu time of %s (%s), charging wall-clock time", color_name(color).c_str(), ge[color]->getname().c_str());
+		}
+	}
+
+	if (tc.constant_time) {
+		if (took > uint64_t(tc.main_time * 1e9))
+			time_left[color] = -1;
+
+		time_total[color] += took;
+	}
+	else {
+		time_total[color] += took;
+		time_left [color] -= took;
+
+		stones_to_do[color]--;
+
+		if (time_left[color] < 0) {
+			if (ts[color] == ts_main_time)
+				ts[color] = ts_byo_yomi_time;
+			else {
+				if (stones_to_do[color] != 0) {
+					dolog(info, "%s (%s) did not return enought byo yomi moves: %d left", color_name(color).c_str(), ge[color]->getname().c_str(), stones_to_do[color]);
+					result = "?";
+					rr = RR_ERROR;
+
+					end_of_moves();
+
+					return;
 				}
 			}
+
+			time_left[color]    = int64_t(tc.byo_yomi_time * 1e9);
+			stones_to_do[color] = tc.byo_yomi_stones;
+		}
+	}
+
+	n_played[color]++;
+
+	if (cc)
+		cc->report_move(took, uint64_t(budget * 1e9));
+
+	move = str_tolower(gm.response.value().at(0));
+
+	if (move == "resign") {
+		if (color == C_BLACK) {
+			result = "W+Resign";
+			insert_result(s, pb->getname(), "black resign");
+		}
+		else {
+			result = "B+Resign";
+			insert_result(s, pw->getname(), "white resign");
+		}
+
+		end_of_moves();
+
+		return;
+	}
+
+	color_t opponent_color = color == C_BLACK ? C_WHITE : C_BLACK;
+
+	state = S_PLAY;
+
+	play_everywhere({ ge[opponent_color] }, color, move);
+}
+
+void Game::play_done()
+{
+	color_t opponent_color = color == C_BLACK ? C_WHITE : C_BLACK;
+
+	GtpEngine *play_hung = nullptr;
+	auto       pm_rc     = play_result(&play_hung);
+
+	if (pm_rc == PM_TIMEOUT) {
+		hung(play_hung, "play " + move);
+	}
+	else if (pm_rc == PM_ENGINE_FAILED) {
+		dolog(warning, "%s (%s) did not accept %s of %s (move %d)", color_name(opponent_color).c_str(), ge[opponent_color]->getname().c_str(), move.c_str(), color_name(color).c_str(), n_played[color]);
+		result = "?";
+		rr = RR_ERROR;
+	}
+	else if (pm_rc == PM_ILLEGAL) {
+		dolog(warning, "%s (%s) performed an illegal move (move %d, %s)", color_name(color).c_str(), ge[color]->getname().c_str(), n_played[color], ge[color]->get_loghelper().c_str());
+
+		if (color == C_BLACK) {
+			result = "W+Illegal";
+			insert_result(s, pb->getname(), "black illegal move");
+		}
+		else {
+			result = "B+Illegal";
+			insert_result(s, pw->getname(), "white illegal move");
+		}
+	}
+	else if (time_left[color] < 0) {
+		if (color == C_BLACK) {
+			result = "W+Time";
+			insert_result(s, pb->getname(), "black out of time");
+		}
+		else {
+			result = "B+Time";
+			insert_result(s, pw->getname(), "white out of time");
+		}
+	}
+	else if (move == "pass") {
+		bool end = pass[color];
+
+		pass[color] = true;
+
+		sgf.push_back(color == C_BLACK ? "B[]" : "W[]");
+
+		if (end) {
+			end_of_moves();
+
+			return;
+		}
+	}
+	else {
+		pass[C_BLACK] = pass[C_WHITE] = false;
+
+		// gtp to sgf
+		char column = move.at(0);
+		if (column >= 'j')
+			column--;
+
+		int row_str = atoi(move.substr(1).c_str());
+		char row = 'a' + row_str - 1;
+
+		std::string move_str = myformat("%c%c", column, row);
+
+		if (color == C_BLACK)
+			sgf.push_back(myformat("B[%s]", move_str.c_str()));
+		else
+			sgf.push_back(myformat("W[%s]", move_str.c_str()));
+	}
+
+	if (result.has_value()) {
+		end_of_moves();
+
+		return;
+	}
+
+	color = opponent_color;
+
+	next_genmove();
+}
+
+// the game ended or an engine hung; the result may not be known yet
+void Game::end_of_moves()
+{
+	dolog(info, "Black (%s) used %.3fs per move (%.3f total), %d moves, white (%s) used %.3fs per move (%.3f total), %d moves",
+			pb->getname().c_str(), time_total[C_BLACK] / 1e9 / n_played[C_BLACK], time_total[C_BLACK] / 1e9, n_played[C_BLACK],
+			pw->getname().c_str(), time_total[C_WHITE] / 1e9 / n_played[C_WHITE], time_total[C_WHITE] / 1e9, n_played[C_WHITE]);
+
+	if (result.has_value() == false) {
+		if (board)
+			result = board->result(komi);
+
+		// without a board the scorer is the referee, else it is a cross-check
+		if (scorer) {
+			state = S_SCORE;
+
+			begin();
+
+			send(scorer, "final_score");
+
+			end_sends();
+
+			return;
+		}
+	}
+
+	scored();
+}
+
+void Game::score_done()
+{
+	const command_t & c = commands.at(0);
+
+	if (board) {
+		if (c.timed_out)
+			scorer->kill();
+
+		if (c.response.has_value() == false || str_toupper(c.response.value().at(0)) != result.value())
+			dolog(warning, "Built-in board scored %s, scorer says %s", result.value().c_str(), c.response.has_value() ? c.response.value().at(0).c_str() : "-");
+	}
+	else {
+		if (c.response.has_value())
+			result = c.response.value().at(0);
+
+		if (c.timed_out) {
+			dolog(warning, "The scorer did not respond to final_score in time");
+
+			scorer->kill();
 		}
 	}
+
+	scored();
+}
+
+void Game::scored()
+{
+	if (result.has_value()) {
+		insert_result(s, pb->getname(), "black games played");
+
+		insert_result(s, pw->getname(), "white games played");
+	}
+
+	if (rr == RR_OK && result.has_value()) {
+		// informational only: an engine that does not answer in time is not
+		// re-used but does not lose
+		state = S_ENGINE_SCORES;
+
+		begin();
+
+		send(pb, "final_score");
+		send(pw, "final_score");
+
+		end_sends();
+
+		return;
+	}
+
+	complete();
+}
+
+void Game::engine_scores_done()
+{
+	const command_t & b = commands.at(0);
+	const command_t & w = commands.at(1);
+
+	if (b.timed_out)
+		pb->kill();
+
+	if (w.timed_out)
+		pw->kill();
+
+	dolog(info, "Result according to black: %s, according to white: %s, referee: %s",
+			b.response.has_value() ? b.response.value().at(0).c_str() : "-",
+			w.response.has_value() ? w.response.value().at(0).c_str() : "-",
+			result.value().c_str());
+
+	complete();
+}
+
+void Game::complete()
+{
+	delete board;
+	board = nullptr;
+
+	uint64_t play_took = get_ts_ns() - play_start_ts;
+	uint64_t think     = think_total;
+
+	s->play_ns  += play_took;
+	s->think_ns += think;
+
+	// setup, pipes, the referee and such
+	dolog(info, "Game took %.3fs of which %.3fs thinking, overhead: %.3fs (%.1f%%)", play_took / 1e9, think / 1e9, (play_took - std::min(play_took, think)) / 1e9, (play_took - std::min(play_took, think)) * 100. / play_took);
+
+	starter->post([this] { finish(); });
+}
+
+// the engines are returned to the pool; runs in a thread of 'starter'
+void Game::finish()
+{
+	// 'latency' may not outlive the game, the engines can
+	pw->set_command_latency(nullptr);
+	pb->set_command_latency(nullptr);
+
+	if (cc) {
+		cc->remove_pid(pw->get_pid());
+		cc->remove_pid(pb->get_pid());
+	}
+
+	game_t g { result, sgf, rr, name1, name2, get_ts_ns() - start_ts, start_t, opening, { time_total[C_BLACK], time_total[C_WHITE] } };
+
+	if (g.result.has_value() == false) {
+		pool->put(p2, pw, false);
+		pool->put(p1, pb, false);
+		if (scorer)
+			pool->put(ps, scorer, false);
+	}
+	else {
+		std::string result_lc = str_tolower(g.result.value());
+
+		// after an error, an engine may still be busy with e.g. a genmove
+		bool reusable = g.rr == RR_OK;
+
+		// the opponent of an engine that hung is fine
+		bool black_hung = g.rr == RR_TIMEOUT && result_lc.at(0) == 'w';
+		bool white_hung = g.rr == RR_TIMEOUT && result_lc.at(0) == 'b';
+
+		pool->put(p2, pw, reusable || (g.rr == RR_TIMEOUT && !white_hung));
+
+		pool->put(p1, pb, reusable || (g.rr == RR_TIMEOUT && !black_hung));
+
+		if (scorer)
+			pool->put(ps, scorer, reusable);
+	}
+
+	auto done = finished;
+
+	delete this;
+
+	done(g);
+}
+
+// statistics, ratings and sprt; also for games of an earlier run (see Journal)
+void account_game(const game_t & g, engine_parameters_t *const p1, engine_parameters_t *const p2, stats_t *const s, const int nr, Sprt *const sprt)
+{
+	const std::string & name1 = g.name1;
+	const std::string & name2 = g.name2;
+
+	if (g.result.has_value() == false) {
+		if (sprt)
+			sprt->add(nr, p1, "?");
+
+		return;
+	}
+
+	std::string result = str_tolower(g.result.value());
+
+	if (g.rr == RR_OK) {
+		s->ok++;
+		s->ok_took += g.took;
+	}
+	else if (g.rr == RR_ERROR) {
+		s->error++;
+	}
+	else if (g.rr == RR_TIMEOUT) {
+		s->timeout++;
+	}
+
+	double p1_v = 0.0;
+	double p2_v = 0.0;
+
+	if (result.at(0) == 'b') {
+		p1_v = 1.0;
+		p2_v = 0.0;
+	}
+	else if (result.at(0) == 'w') {
+		p1_v = 0.0;
+		p2_v = 1.0;
+	}
+	else if (result.at(0) == '?') {
+		// some error
+		std::string key = name1 + " versus " + name2;
+
+		s->errors_lock.lock();
+
+		auto it = s->errors.find(key);
+		if (it == s->errors.end())
+			s->errors.insert({ key, 1 });
+		else
+			it->second++;
+
+		s->errors_lock.unlock();
+	}
 	else {
-		dolog(info, "gauntlet(s)");
+		p1_v = 0.5;
+		p2_v = 0.5;
+	}
+
+	if (sprt)
+		sprt->add(nr, p1, result);
+
+	if (s->ratings)
+		s->ratings->add(p1, p2, result);
+
+	if (result.at(0) != '?') {
+		{
+			std::unique_lock<std::mutex> lck(p1->lock);
+			p1->rating.Update(p2->rating, p1_v);
+			p1->rating.Apply();
+		}
+
+		{
+			std::unique_lock<std::mutex> lck(p2->lock);
+			p2->rating.Update(p1->rating, p2_v);
+			p2->rating.Apply();
+		}
+	}
+}
+
+// statistics, ratings, sprt, the pgn/sgf files and the journal; for games
+// played on this host and by workers
+void record_game(const game_t & g, engine_parameters_t *const p1, engine_parameters_t *const p2, const int dim, ResultWriter *const writer, stats_t *const s, const double komi, const int n_random_stones, const int nr, Sprt *const sprt)
+{
+	const std::string & name1 = g.name1;
+	const std::string & name2 = g.name2;
+
+	std::string meta_str = myformat("%d> ", nr);
+
+	account_game(g, p1, p2, s, nr, sprt);
+
+	// out of time or hung (RR_TIMEOUT); only for the games of this run, not
+	// for those that replay_journal() accounts
+	if (g.result.has_value()) {
+		std::string result = str_tolower(g.result.value());
+
+		if (result == "w+time")
+			p1->n_time_losses++;
+		else if (result == "b+time")
+			p2->n_time_losses++;
+	}
+
+	s->n_played++;
+
+	if (g.result.has_value()) {
+		p1->latency.time_used_ns += g.time_used[C_BLACK];
+		p1->latency.n_games++;
+
+		p2->latency.time_used_ns += g.time_used[C_WHITE];
+		p2->latency.n_games++;
+	}
+
+	game_record_t *r = new game_record_t { nr, "", "", journal_entry_t { nr, p1, p2, g.result, int(g.rr), g.took } };
+
+	if (g.result.has_value() == false) {
+		dolog(info, "Game between %s and %s failed", name1.c_str(), name2.c_str());
+
+		writer->add(r);
+
+		return;
+	}
+
+	std::string result = str_tolower(g.result.value());
+
+	std::string result_pgn = "1/2-1/2";
+
+	if (result.at(0) == 'b')
+		result_pgn = "0-1";
+	else if (result.at(0) == 'w')
+		result_pgn = "1-0";
+
+	if (result.at(0) != '?')
+		r->pgn = myformat("[White \"%s\"]\n[Black \"%s\"]\n[Result \"%s\"]\n\n%s\n\n", name2.c_str(), name1.c_str(), result_pgn.c_str(), result_pgn.c_str());
+
+	tm tm { };
+	localtime_r(&g.start_t, &tm);
+
+	r->sgf = myformat("(;AP[Badank]DT[%04d-%02d-%02d]GM[1]KM[%f]SZ[%d]PW[%s]\nPB[%s]\nRE[%s]\nC[%s]RU[Tromp/Taylor]\n(", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, komi, dim, name2.c_str(), name1.c_str(), str_toupper(result).c_str(), meta_str.c_str());
+
+	for(const std::string & vertex : g.sgf)
+		r->sgf += ";" + vertex;
+
+	if (g.rr != RR_OK)
+		r->sgf += myformat(";C[%s]", result.c_str());
+
+	r->sgf += myformat(";C[Initial %d black and %d white stones were placed randomly by Badank]", n_random_stones, n_random_stones);
+
+	r->sgf += ")\n)\n\n";
+
+	if (writer->has_archive()) {
+		archive_record_t ar { };
+		ar.header.nr              = nr;
+		ar.header.dim             = dim;
+		ar.header.winner          = archive_winner(g.result.value());
+		ar.header.rr              = g.rr;
+		ar.header.n_random_stones = n_random_stones;
+		ar.header.komi            = komi;
+		ar.header.opening         = g.opening;
+		ar.header.start_t         = g.start_t;
+		ar.header.took            = g.took;
+		ar.header.time_used[0]    = g.time_used[C_BLACK];
+		ar.header.time_used[1]    = g.time_used[C_WHITE];
+		strncpy(ar.header.result, g.result.value().c_str(), sizeof ar.header.result - 1);
+
+		ar.black = name1;
+		ar.white = name2;
+
+		for(const std::string & vertex : g.sgf) {
+			auto move = archive_encode_move(vertex);
+
+			if (move.has_value())
+				ar.moves.push_back(move.value());
+		}
+
+		r->archive = ar;
+	}
+
+	// the files are written by an other thread
+	writer->add(r);
+
+	{
+		std::unique_lock<std::mutex> lck1(p1->lock);
+		double r1 = p1->rating.Rating1();
+		lck1.unlock();
+
+		std::unique_lock<std::mutex> lck2(p2->lock);
+		double r2 = p2->rating.Rating2();
+		lck2.unlock();
+
+		dolog(info, "%s (black; %f elo) versus %s (white; %f elo) result: %s, took: %fs", name1.c_str(), r1, name2.c_str(), r2, result.c_str(), g.took / 1e9);
+	}
+}
+
+// what is needed to play the games of play_batch() on this host: a game at a
+// time per slot (0...concurrency-1)
+typedef struct {
+	const engine_parameters_t       *scorer;
+	int                              dim;
+	ResultWriter                    *writer;
+	stats_t                         *s;
+	std::atomic_bool                *stop_flag;
+	time_control_t                   tc;
+	double                           komi;
+	int                              n_random_stones;
+	const std::vector<book_entry_t> *book_entries;
+	Scheduler                       *scheduler;
+	EnginePool                      *pool;
+	const Placement                 *placement;
+	ConcurrencyController           *cc;
+	Sprt                            *sprt;
+	Queue<int>                      *finished;  // slots without more games
+	int                              lookahead;
+	TaskRunner                      *runner;
+	TaskRunner                      *starter;
+
+	// slots that wait for a game (one in progress may be requeued) or for
+	// the concurrency controller, see play_batch()
+	std::mutex                       parked_lock;
+	std::vector<int>                 parked;
+} batch_t;
+
+// starts the next game of 'slot'; runs in a thread of 'starter'
+void next_game(batch_t *const b, const int slot)
+{
+	if (*b->stop_flag || b->scheduler->is_finished()) {
+		dolog(info, "Work finished for slot %d", slot);
+
+		b->finished->push(slot);
+
+		return;
+	}
+
+	std::optional<work_t> work;
+
+	if (b->cc == nullptr || b->cc->may_start(slot))
+		work = b->scheduler->try_next();
+
+	if (work.has_value() == false) {
+		std::unique_lock<std::mutex> lck(b->parked_lock);
+
+		b->parked.push_back(slot);
+
+		return;
+	}
+
+	work_t entry = work.value();
+
+	// start the engines for the games that the slots take next (one each)
+	// while this game is played
+	std::map<const engine_parameters_t *, int> needed;
+
+	for(auto & w : b->scheduler->peek(b->lookahead)) {
+		needed[w.p1]++;
+		needed[w.p2]++;
+
+		if (b->scorer)
+			needed[b->scorer]++;
+	}
+
+	for(auto & n : needed)
+		b->pool->prewarm(n.first, n.second);
+
+	engine_latency_t *latency[] { &entry.p1->latency, &entry.p2->latency };
+
+	Game *g = new Game(myformat("%d> ", entry.nr), entry.p1, entry.p2, b->scorer, b->dim, b->s, b->tc, b->komi, b->n_random_stones, b->book_entries, b->pool, b->placement, slot, b->cc, entry.nr, latency, b->runner, b->starter, [b, slot, entry](const game_t & result) {
+		record_game(result, entry.p1, entry.p2, b->dim, b->writer, b->s, b->komi, b->n_random_stones, entry.nr, b->sprt);
+
+		b->scheduler->done(entry);
+
+		// the other slots finish the games they are playing
+		if (b->sprt && b->sprt->is_decided())
+			*b->stop_flag = true;
+
+		next_game(b, slot);
+	});
+
+	g->start();
+}
+
+// distributed mode: the coordinator (a normal run with 'listen_port' set)
+// hands out games to workers ("badank --worker host[:port] [n]") over tcp.
+// A worker opens one connection per game it plays concurrently. The lines
+// are tab separated:
+// coordinator: "badank" version, then "refused" or "config", "book" path count
+//              checksum, "scorer", "engine"..., "end", then "game" nr black
+//              white (indexes of the engines) or "bye"
+// worker:      "secret" (after "badank"; can be empty), "stat" name key count..., "result" nr result rr took start play think
+//              opening black-time white-time moves
+#define PROTOCOL_VERSION 5
+#define DEFAULT_PORT     2300
+
+typedef struct {
+	int            dim;
+	double         komi;
+	time_control_t tc;
+	int            n_random_stones;
+	double         command_timeout;
+	std::string    sgf_book_path;
+	size_t         book_size;  // the openings are selected by index
+	uint64_t       book_checksum;
+	const engine_parameters_t *scorer;
+	std::vector<engine_parameters_t *> engines;
+	std::string    secret;  // what a worker must send, see check_worker()
+} remote_config_t;
+
+// the secret is sent in plain text: it keeps out strangers, not eavesdroppers
+bool check_worker(NetConnection *const c, const remote_config_t & rc, std::atomic_bool *const stop_flag)
+{
+	if (c->send_line(myformat("badank\t%d", PROTOCOL_VERSION)) == false)
+		return false;
+
+	auto line = c->read_line(stop_flag, 10000);
+
+	if (line.has_value() == false)
+		return false;
+
+	auto parts = split_fields(line.value(), '\t');
+
+	// compared in constant time
+	bool ok = parts.size() == 2 && parts.at(0) == "secret" && parts.at(1).size() == rc.secret.size();
+
+	unsigned char diff = 0;
+
+	for(size_t i=0; ok && i<rc.secret.size(); i++)
+		diff |= parts.at(1).at(i) ^ rc.secret.at(i);
+
+	if (ok && diff == 0)
+		return true;
+
+	dolog(warning, "Worker %s did not send the right secret (\"listen_secret\")", c->get_peer().c_str());
+
+	c->send_line("refused");
+
+	return false;
+}
+
+bool send_config(NetConnection *const c, const remote_config_t & rc)
+{
+	const time_control_t & tc = rc.tc;
+
+	bool ok = c->send_line(myformat("config\t%d\t%f\t%f\t%f\t%d\t%d\t%d\t%f\t%f\t%d\t%f", rc.dim, rc.komi, tc.main_time, tc.byo_yomi_time, tc.byo_yomi_stones, tc.constant_time, tc.cpu_time, tc.cpu_time_wall_factor, tc.genmove_grace, rc.n_random_stones, rc.command_timeout));
+
+	if (rc.sgf_book_path.empty() == false)
+		ok &= c->send_line(myformat("book\t%s\t%zu\t%" PRIu64, rc.sgf_book_path.c_str(), rc.book_size, rc.book_checksum));
+
+	if (rc.scorer)
+		ok &= c->send_line("scorer\t" + rc.scorer->command + "\t" + rc.scorer->directory);
+
+	for(auto & ep : rc.engines)
+		ok &= c->send_line("engine\t" + ep->command + "\t" + ep->directory + "\t" + ep->alt_name);
+
+	ok &= c->send_line("end");
+
+	return ok;
+}
+
+// nothing when the worker disconnected or sent something unexpected
+std::optional<game_t> receive_result(NetConnection *const c, const work_t & w, stats_t *const s, std::atomic_bool *const stop_flag)
+{
+	std::vector<std::tuple<std::string, std::string, int> > results;
+
+	std::vector<std::tuple<int, int, histogram_snapshot_t> > latencies;  // colour, kind (see the worker)
+
+	for(;;) {
+		auto line = c->read_line(stop_flag);
+
+		if (line.has_value() == false)
+			return { };
+
+		auto parts = split_fields(line.value(), '\t');
+
+		if (parts.at(0) == "stat" && parts.size() == 4) {
+			results.push_back({ parts.at(1), parts.at(2), atoi(parts.at(3).c_str()) });
+
+			continue;
+		}
+
+		if (parts.at(0) == "latency" && parts.size() == 4) {
+			int  colour = atoi(parts.at(1).c_str());
+			int  kind   = atoi(parts.at(2).c_str());
+			auto h      = histogram_from_string(parts.at(3));
+
+			if ((colour == C_BLACK || colour == C_WHITE) && kind >= 0 && kind <= GP_N && h.has_value())
+				latencies.push_back({ colour, kind, h.value() });
+
+			continue;
+		}
+
+		if (parts.at(0) != "result" || parts.size() != 12 || atoi(parts.at(1).c_str()) != w.nr) {
+			dolog(warning, "Unexpected response from worker %s: %s", c->get_peer().c_str(), line.value().c_str());
+
+			return { };
+		}
+
+		game_t g;
+
+		if (parts.at(2).empty() == false)
+			g.result = parts.at(2);
+
+		g.rr      = run_result_t(atoi(parts.at(3).c_str()));
+		g.took    = strtoull(parts.at(4).c_str(), nullptr, 10);
+		g.start_t = time_t(strtoll(parts.at(5).c_str(), nullptr, 10));
+		g.name1   = w.p1->name;
+		g.name2   = w.p2->name;
+		g.opening = atoi(parts.at(8).c_str());
+		g.sgf     = split(parts.at(11), ";");
+
+		g.time_used[C_BLACK] = strtoull(parts.at(9).c_str(), nullptr, 10);
+		g.time_used[C_WHITE] = strtoull(parts.at(10).c_str(), nullptr, 10);
+
+		s->play_ns  += strtoull(parts.at(6).c_str(), nullptr, 10);
+		s->think_ns += strtoull(parts.at(7).c_str(), nullptr, 10);
+
+		for(auto & r : results)
+			insert_result(s, std::get<0>(r), std::get<1>(r), std::get<2>(r));
+
+		for(auto & l : latencies) {
+			engine_latency_t *latency = &(std::get<0>(l) == C_BLACK ? w.p1 : w.p2)->latency;
+
+			if (std::get<1>(l) < GP_N)
+				latency->genmove[std::get<1>(l)].add(std::get<2>(l));
+			else
+				latency->command.add(std::get<2>(l));
+		}
+
+		return g;
+	}
+}
+
+// plays the games of one connection of a worker
+void remote_thread(NetConnection *const c, const remote_config_t *const rc, Scheduler *const scheduler, ResultWriter *const writer, stats_t *const s, std::atomic_bool *const stop_flag, Sprt *const sprt)
+{
+	std::string peer = c->get_peer();
+
+	dolog(info, "Worker %s connected", peer.c_str());
+
+	std::map<const engine_parameters_t *, int> index;
+
+	for(size_t i=0; i<rc->engines.size(); i++)
+		index.insert({ rc->engines.at(i), i });
+
+	bool connected = check_worker(c, *rc, stop_flag) && send_config(c, *rc);
+
+	while(connected && !*stop_flag) {
+		auto work = scheduler->next(stop_flag);
+
+		if (work.has_value() == false)
+			break;
+
+		work_t entry = work.value();
+
+		std::optional<game_t> g;
+
+		if (c->send_line(myformat("game\t%d\t%d\t%d", entry.nr, index.at(entry.p1), index.at(entry.p2))))
+			g = receive_result(c, entry, s, stop_flag);
+
+		if (g.has_value() == false) {
+			if (*stop_flag == false)
+				dolog(warning, "Lost worker %s during game %d", peer.c_str(), entry.nr);
+
+			scheduler->requeue(entry);
+
+			connected = false;
+
+			break;
+		}
+
+		dolog(info, "%d> played by worker %s", entry.nr, peer.c_str());
+
+		record_game(g.value(), entry.p1, entry.p2, rc->dim, writer, s, rc->komi, rc->n_random_stones, entry.nr, sprt);
+
+		scheduler->done(entry);
+
+		if (sprt && sprt->is_decided())
+			*stop_flag = true;
+	}
+
+	if (connected)
+		c->send_line("bye");
+
+	dolog(info, "Worker %s disconnected", peer.c_str());
+
+	delete c;
+}
+
+void accept_thread(NetListener *const listener, const remote_config_t *const rc, Scheduler *const scheduler, ResultWriter *const writer, stats_t *const s, std::atomic_bool *const stop_flag, Sprt *const sprt, std::atomic_bool *const stop_accepting, std::vector<std::thread *> *const remote_threads)
+{
+	while(!*stop_accepting) {
+		NetConnection *c = listener->accept_connection(500);
+
+		if (c)
+			remote_threads->push_back(new std::thread(remote_thread, c, rc, scheduler, writer, s, stop_flag, sprt));
+	}
+}
+
+// rebuilds the ratings and statistics of an earlier run from its journal,
+// those games are not played again
+void replay_journal(const Journal *const journal, Scheduler *const scheduler, stats_t *const s, Sprt *const sprt)
+{
+	for(auto & e : journal->get_entries()) {
+		game_t g { e.result, { }, run_result_t(e.rr), e.p1->name, e.p2->name, e.took, 0 };
+
+		if (e.result.has_value()) {
+			insert_result(s, e.p1->name, "black games played");
+			insert_result(s, e.p2->name, "white games played");
+
+			// what play() counted for the side that lost
+			std::string result = str_tolower(e.result.value());
+			std::string loser  = result.at(0) == 'w' ? "black" : "white";
+			std::string name   = result.at(0) == 'w' ? e.p1->name : e.p2->name;
+
+			if (result == "w+resign" || result == "b+resign")
+				insert_result(s, name, loser + " resign");
+			else if (result == "w+illegal" || result == "b+illegal")
+				insert_result(s, name, loser + " illegal move");
+			else if (result == "w+time" || result == "b+time")
+				insert_result(s, name, loser + (e.rr == RR_TIMEOUT ? " hung" : " out of time"));
+		}
+
+		account_game(g, e.p1, e.p2, s, e.nr, sprt);
+
+		scheduler->restore({ e.p1, e.p2, e.nr });
+	}
+}
+
+// only reads counters (and the ratings that poll() computed last), so that
+// it never waits for the threads that play the games or for a rating solve;
+// 'samples': (time, games) of earlier calls
+std::vector<metric_t> collect_metrics(const std::vector<engine_parameters_t *> & engines, stats_t *const s, const Scheduler *const scheduler, const ResultWriter *const writer, std::deque<std::pair<uint64_t, uint64_t> > *const samples)
+{
+	std::vector<metric_t> out;
+
+	uint64_t now      = get_ts_ns();
+	uint64_t n_played = s->n_played;
+
+	// games per second over the last minute
+	samples->push_back({ now, n_played });
+
+	while(samples->size() > 2 && now - samples->at(1).first >= 60000000000ll)
+		samples->pop_front();
+
+	double took = (now - samples->front().first) / 1e9;
+	double gps  = took > 0. ? (n_played - samples->front().second) / took : 0.;
+
+	out.push_back({ "badank_games_completed_total", "counter", "Games finished in this run", { }, double(n_played) });
+	out.push_back({ "badank_games_per_second", "gauge", "Games finished per second over the last minute", { }, gps });
+	out.push_back({ "badank_games_active", "gauge", "Games in progress, also those of workers", { }, double(scheduler->get_n_busy()) });
+	out.push_back({ "badank_games_waiting", "gauge", "Games that were not started yet", { }, double(scheduler->get_n_waiting()) });
+	out.push_back({ "badank_games_total", "gauge", "Games in the tournament", { }, double(scheduler->get_n_games()) });
+	out.push_back({ "badank_writer_queue_depth", "gauge", "Games that were not written to disk yet", { }, double(writer->get_queue_depth()) });
+	out.push_back({ "badank_game_errors_total", "counter", "Games that ended because of an error", { }, double(s->error) });
+	out.push_back({ "badank_game_timeouts_total", "counter", "Games that ended because an engine hung", { }, double(s->timeout) });
+
+	for(auto ep : engines)
+		out.push_back({ "badank_time_losses_total", "counter", "Games lost on time (out of time or hung)", { { "engine", ep->name } }, double(ep->n_time_losses) });
+
+	for(auto ep : engines) {
+		histogram_snapshot_t h = genmove_snapshot(ep->latency);
+
+		for(double q : { 0.5, 0.9, 0.99 })
+			out.push_back({ "badank_genmove_seconds", "summary", "Duration of a genmove", { { "engine", ep->name }, { "quantile", myformat("%g", q) } }, histogram_quantile(h, q) / 1e6 });
+
+		out.push_back({ "badank_genmove_seconds_sum", "summary", "", { { "engine", ep->name } }, h.sum / 1e6 });
+		out.push_back({ "badank_genmove_seconds_count", "summary", "", { { "engine", ep->name } }, double(h.n) });
+	}
+
+	for(auto ep : engines)
+		out.push_back({ "badank_genmove_seconds_max", "gauge", "Longest genmove", { { "engine", ep->name } }, genmove_snapshot(ep->latency).max / 1e6 });
+
+	if (s->ratings) {
+		auto ratings = s->ratings->get_ratings();
+
+		for(auto & r : ratings)
+			out.push_back({ "badank_elo", "gauge", "Maximum likelihood elo rating", { { "engine", r.engine->name } }, r.elo });
+
+		for(auto & r : ratings)
+			out.push_back({ "badank_elo_error", "gauge", "95% confidence interval of the elo rating (+/-)", { { "engine", r.engine->name } }, r.error });
+	}
+
+	return out;
+}
+
+void play_batch(const std::vector<engine_parameters_t *> & engines, const engine_parameters_t *const scorer, const int dim, ResultWriter *const writer, const int concurrency, const int iterations, stats_t *const s, const time_control_t & tc, const double komi, const int n_random_stones, std::vector<book_entry_t> *const book_entries, std::atomic_bool *const stop_flag, EnginePool *const pool, const Placement *const placement, ConcurrencyController *const cc, Sprt *const sprt, Journal *const journal, const bool dynamic_pairing, const int pairing_min_games, const bool pairing_colour_balance, NetListener *const listener, const remote_config_t *const rc, const std::string & metrics_address, const int metrics_port, const int game_threads)
+{
+	dolog(info, "Batch starting");
+
+	Scheduler scheduler(engines, iterations, dynamic_pairing, pairing_min_games, pairing_colour_balance);
+
+	int n_played_before = 0;
+
+	if (journal) {
+		replay_journal(journal, &scheduler, s, sprt);
+
+		n_played_before = journal->get_entries().size();
+	}
+
+	dolog(info, "Will play %d games", scheduler.get_n_games() - n_played_before);
+
+	MetricsServer *metrics = nullptr;
+
+	std::deque<std::pair<uint64_t, uint64_t> > metrics_samples { { get_ts_ns(), 0 } };
+
+	if (metrics_port)
+		metrics = new MetricsServer(metrics_address, metrics_port, [&] { return collect_metrics(engines, s, &scheduler, writer, &metrics_samples); });
+
+	if (sprt && sprt->is_decided())
+		*stop_flag = true;
+
+	Queue<int> finished(concurrency);
+
+	// every slot has at most one step of its game and one start pending
+	TaskRunner runner ("game",  game_threads, concurrency * 2 + 16);
+	TaskRunner starter("start", game_threads, concurrency * 2 + 16);
+
+	batch_t b { scorer, dim, writer, s, stop_flag, tc, komi, n_random_stones, book_entries, &scheduler, pool, placement, cc, sprt, &finished, concurrency, &runner, &starter };
+
+	for(int i=0; i<concurrency; i++)
+		starter.post([&b, i] { next_game(&b, i); });
+
+	std::thread             *accept_th = nullptr;
+	std::atomic_bool         stop_accepting { false };
+	std::vector<std::thread *> remote_threads;
+
+	if (listener)
+		accept_th = new std::thread(accept_thread, listener, rc, &scheduler, writer, s, stop_flag, sprt, &stop_accepting, &remote_threads);
+
+    	dolog(info, "Waiting for the games to finish...");
+
+	for(int n_left=concurrency; n_left > 0;) {
+		auto rc = finished.pop(250);
+
+		if (s->ratings)
+			s->ratings->poll(ratings_requested.exchange(false));
+
+		// a game may have been requeued, the concurrency controller may allow more games
+		std::vector<int> parked;
+
+		{
+			std::unique_lock<std::mutex> lck(b.parked_lock);
+
+			parked.swap(b.parked);
+		}
+
+		for(int slot : parked)
+			starter.post([&b, slot] { next_game(&b, slot); });
+
+		if (rc.has_value() == false)
+			continue;
+
+		n_left--;
+
+		dolog(info, "%d slots left", n_left);
+	}
+
+	if (listener) {
+		dolog(info, "Waiting for the games of the workers...");
+
+		while(!*stop_flag && !scheduler.is_finished()) {
+			mymsleep(100);
+
+			if (s->ratings)
+				s->ratings->poll(ratings_requested.exchange(false));
+		}
+
+		stop_accepting = true;
+
+		accept_th->join();
+
+		delete accept_th;
+
+		for(auto & th : remote_threads) {
+			th->join();
+
+			delete th;
+		}
+	}
+
+	delete metrics;
+
+    	dolog(info, "Batch finished");
+}
+
+void test_config(const std::vector<engine_parameters_t *> & eo, EnginePool *const pool)
+{
+	bool err = false;
+
+	dolog(info, "Verifying configuration...");
+
+	for(auto ep : eo) {
+		dolog(info, "Trying %s", ep->command.c_str());
+
+		GtpEngine *test = pool->get(ep);
+
+		auto rc = test->protocol_version();
+		if (rc.has_value() == false) {
+			dolog(error, "Cannot talk to: %s", ep->command.c_str());
+			err = true;
+		}
+		else {
+			ep->name = test->getname();
+
+			share_engine_details(ep, test);
+		}
+
+		// no need to start it again for the first game
+		pool->put(ep, test, rc.has_value());
+	}
+
+	if (err) {
+		dolog(warning, "Terminating because of error(s)");
+		exit(1);
+	}
+}
+
+void sigh(int sig)
+{
+	stop_flag = true;
+
+	dolog(notice, "Program termination triggered by ^c (SIGINT)");
+}
+
+void sigusr1(int sig)
+{
+	ratings_requested = true;
+}
+
+// 'keep': the first connection; the others receive the same configuration
+bool receive_config(NetConnection *const c, remote_config_t *const rc, std::vector<book_entry_t> *const book_entries, const std::string & secret, const bool keep)
+{
+	auto hello = c->read_line(&stop_flag);
+
+	if (hello.has_value() == false || hello.value() != myformat("badank\t%d", PROTOCOL_VERSION)) {
+		dolog(error, "Coordinator %s does not speak protocol version %d", c->get_peer().c_str(), PROTOCOL_VERSION);
+
+		return false;
+	}
+
+	if (c->send_line("secret\t" + secret) == false)
+		return false;
+
+	for(;;) {
+		auto line = c->read_line(&stop_flag);
+
+		if (line.has_value() == false)
+			return false;
+
+		auto parts = split_fields(line.value(), '\t');
+
+		if (parts.at(0) == "end")
+			return true;
+
+		if (parts.at(0) == "refused") {
+			dolog(error, "Coordinator %s refused the secret (BADANK_SECRET)", c->get_peer().c_str());
+
+			return false;
+		}
+
+		if (keep == false)
+			continue;
+
+		if (parts.at(0) == "config" && parts.size() == 12) {
+			rc->dim                     = atoi(parts.at(1).c_str());
+			rc->komi                    = atof(parts.at(2).c_str());
+			rc->tc.main_time            = atof(parts.at(3).c_str());
+			rc->tc.byo_yomi_time        = atof(parts.at(4).c_str());
+			rc->tc.byo_yomi_stones      = atoi(parts.at(5).c_str());
+			rc->tc.constant_time        = atoi(parts.at(6).c_str());
+			rc->tc.cpu_time             = atoi(parts.at(7).c_str());
+			rc->tc.cpu_time_wall_factor = atof(parts.at(8).c_str());
+			rc->tc.genmove_grace        = atof(parts.at(9).c_str());
+			rc->n_random_stones         = atoi(parts.at(10).c_str());
+			rc->command_timeout         = atof(parts.at(11).c_str());
+		}
+		else if (parts.at(0) == "book" && parts.size() == 4) {
+			rc->sgf_book_path = parts.at(1);
+			rc->book_size     = strtoull(parts.at(2).c_str(), nullptr, 10);
+			rc->book_checksum = strtoull(parts.at(3).c_str(), nullptr, 10);
+
+			load_sgf_opening_files(rc->sgf_book_path, book_entries);
+
+			// else the games would not get the openings the coordinator expects
+			if (book_entries->size() != rc->book_size || book_checksum(*book_entries) != rc->book_checksum) {
+				dolog(error, "The opening book in %s (%zu games) differs from the one of coordinator %s (%zu games)", rc->sgf_book_path.c_str(), book_entries->size(), c->get_peer().c_str(), rc->book_size);
+
+				return false;
+			}
+		}
+		else if ((parts.at(0) == "scorer" && parts.size() == 3) || (parts.at(0) == "engine" && parts.size() == 4)) {
+			engine_parameters_t *ep = new engine_parameters_t();
+
+			ep->command   = parts.at(1);
+			ep->directory = parts.at(2);
+			ep->alt_name  = parts.size() == 4 ? parts.at(3) : "";
+			ep->target    = false;
+
+			if (parts.at(0) == "scorer")
+				rc->scorer = ep;
+			else
+				rc->engines.push_back(ep);
+		}
+		else {
+			dolog(error, "Unexpected configuration from coordinator %s: %s", c->get_peer().c_str(), line.value().c_str());
+
+			return false;
+		}
+	}
+}
+
+// of one game of a worker, sent to the coordinator when it finished
+typedef struct {
+	// only what the game collects, the rest is counted by the coordinator
+	stats_t          s;
+	// they are added to those of the coordinator
+	engine_latency_t latency[2];
+} worker_game_t;
+
+bool send_worker_result(NetConnection *const c, const int nr, const game_t & g, worker_game_t *const wg)
+{
+	bool ok = true;
+
+	for(auto & records : wg->s.results) {
+		for(auto & record : records.second)
+			ok &= c->send_line(myformat("stat\t%s\t%s\t%d", records.first.c_str(), record.first.c_str(), record.second));
+	}
+
+	// per colour: the genmoves per phase of the game, then the other commands
+	for(int colour : { C_BLACK, C_WHITE }) {
+		for(int kind=0; kind<=GP_N; kind++) {
+			histogram_snapshot_t h = kind < GP_N ? wg->latency[colour].genmove[kind].snapshot() : wg->latency[colour].command.snapshot();
+
+			if (h.n)
+				ok &= c->send_line(myformat("latency\t%d\t%d\t%s", colour, kind, histogram_to_string(h).c_str()));
+		}
+	}
+
+	ok &= c->send_line(myformat("result\t%d\t%s\t%d\t%" PRIu64 "\t%lld\t%" PRIu64 "\t%" PRIu64 "\t%d\t%" PRIu64 "\t%" PRIu64 "\t%s", nr, g.result.has_value() ? g.result.value().c_str() : "", int(g.rr), g.took, (long long)g.start_t, uint64_t(wg->s.play_ns), uint64_t(wg->s.think_ns), g.opening, g.time_used[C_BLACK], g.time_used[C_WHITE], merge(g.sgf, ";").c_str()));
+
+	return ok;
+}
+
+// plays the games that the coordinator hands out, 'concurrency' at a time
+int run_worker(const std::string & coordinator, const int concurrency)
+{
+	std::string host;
+	int         port = DEFAULT_PORT;
+
+	split_host_port(coordinator, DEFAULT_PORT, &host, &port);
+
+	if (concurrency < 1)
+		error_exit(false, "A worker should play at least 1 game at a time");
+
+	signal(SIGPIPE, SIG_IGN);
+
+	signal(SIGINT, sigh);
+
+	std::vector<NetConnection *> connections;
+
+	for(int i=0; i<concurrency; i++) {
+		NetConnection *c = NetConnection::connect_to(host, port);
+
+		if (c == nullptr)
+			error_exit(false, "Cannot connect to the coordinator at %s port %d", host.c_str(), port);
+
+		connections.push_back(c);
+	}
+
+	remote_config_t rc { };
+
+	std::vector<book_entry_t> book_entries;
+
+	// see "listen_secret" of the coordinator
+	const char *secret = getenv("BADANK_SECRET");
+
+	for(size_t i=0; i<connections.size(); i++) {
+		if (receive_config(connections.at(i), &rc, &book_entries, secret ? secret : "", i == 0) == false)
+			error_exit(false, "No valid configuration from the coordinator at %s port %d", host.c_str(), port);
+	}
+
+	dolog(info, "Worker playing %d games at a time for %s, %zu engines", concurrency, connections.at(0)->get_peer().c_str(), rc.engines.size());
+
+	set_gtp_command_timeout(int(rc.command_timeout * 1000));
+
+	for(auto & be : book_entries) {
+		if (is_board_size_supported(be.dim) == false && rc.scorer == nullptr)
+			error_exit(false, "The opening book contains a game of board size %d, that requires an external scorer (\"scorer_command\" of the coordinator)", be.dim);
+	}
+
+	init_reactors(1);
+
+	EnginePool *pool = new EnginePool(concurrency, 0, false);
+
+	// the games are played like those of a coordinator, see play_batch()
+	TaskRunner *runner  = new TaskRunner("game",  2, concurrency * 2 + 16);
+	TaskRunner *starter = new TaskRunner("start", 2, concurrency * 2 + 16);
+
+	// connections of which the game finished, and whether its result could be sent
+	Queue<std::pair<int, bool> > played(concurrency);
+
+	int wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (wakeup_fd == -1)
+		error_exit(true, "eventfd failed");
+
+	// a connection is either waiting for the next request or playing a game
+	std::vector<bool> waiting(concurrency, true);
+
+	int n_open = concurrency;
+
+	auto close_connection = [&](const int i) {
+		delete connections.at(i);
+		connections.at(i) = nullptr;
+
+		waiting.at(i) = false;
+
+		n_open--;
+	};
+
+	while(n_open > 0) {
+		std::vector<pollfd> fds { { wakeup_fd, POLLIN, 0 } };
+		std::vector<int>    nrs;
+		bool                buffered = false;
+
+		for(int i=0; i<concurrency; i++) {
+			if (waiting.at(i)) {
+				fds.push_back({ connections.at(i)->get_fd(), POLLIN, 0 });
+				nrs.push_back(i);
+
+				buffered |= connections.at(i)->has_line();
+			}
+		}
+
+		// wake up now and then to see if we should stop
+		if (poll(fds.data(), fds.size(), buffered ? 0 : 500) == -1 && errno != EINTR)
+			error_exit(true, "poll failed");
+
+		uint64_t v = 0;
+		if (fds.at(0).revents && read(wakeup_fd, &v, sizeof v) != sizeof v)
+			dolog(debug, "Reading the wakeup counter failed");
+
+		for(;;) {
+			auto p = played.try_pop();
+
+			if (p.has_value() == false)
+				break;
+
+			if (p.value().second)
+				waiting.at(p.value().first) = true;
+			else
+				close_connection(p.value().first);
+		}
+
+		// the games in progress are finished first
+		if (stop_flag) {
+			for(int i=0; i<concurrency; i++) {
+				if (waiting.at(i))
+					close_connection(i);
+			}
+
+			continue;
+		}
+
+		for(size_t k=0; k<nrs.size(); k++) {
+			int i = nrs.at(k);
+
+			if (waiting.at(i) == false || (fds.at(k + 1).revents == 0 && connections.at(i)->has_line() == false))
+				continue;
+
+			NetConnection *c    = connections.at(i);
+			auto           line = c->read_line(&stop_flag);
+
+			if (line.has_value() == false) {
+				if (stop_flag == false)
+					dolog(warning, "Lost connection to the coordinator %s", c->get_peer().c_str());
+
+				close_connection(i);
+
+				continue;
+			}
+
+			auto parts = split_fields(line.value(), '\t');
+
+			if (parts.at(0) == "bye") {
+				close_connection(i);
+
+				continue;
+			}
+
+			size_t b = parts.size() == 4 ? atoi(parts.at(2).c_str()) : 0;
+			size_t w = parts.size() == 4 ? atoi(parts.at(3).c_str()) : 0;
+
+			if (parts.at(0) != "game" || parts.size() != 4 || b >= rc.engines.size() || w >= rc.engines.size()) {
+				dolog(error, "Unexpected request from coordinator %s: %s", c->get_peer().c_str(), line.value().c_str());
+
+				close_connection(i);
+
+				continue;
+			}
+
+			int nr = atoi(parts.at(1).c_str());
+
+			waiting.at(i) = false;
+
+			starter->post([&, c, i, b, w, nr] {
+				worker_game_t    *wg        = new worker_game_t();
+				engine_latency_t *latency[] { &wg->latency[C_BLACK], &wg->latency[C_WHITE] };
+
+				Game *g = new Game(myformat("%d> ", nr), rc.engines.at(b), rc.engines.at(w), rc.scorer, rc.dim, &wg->s, rc.tc, rc.komi, rc.n_random_stones, &book_entries, pool, nullptr, i, nullptr, nr, latency, runner, starter, [&, c, i, nr, wg](const game_t & result) {
+					bool ok = send_worker_result(c, nr, result, wg);
+
+					delete wg;
+
+					played.push({ i, ok });
+
+					uint64_t one = 1;
+					if (write(wakeup_fd, &one, sizeof one) != sizeof one)
+						dolog(warning, "Cannot wake up the worker");
+				});
+
+				g->start();
+			});
+		}
+	}
+
+	delete starter;
+	delete runner;
+
+	close(wakeup_fd);
+
+	delete pool;
+
+	stop_reactors();
+
+	for(auto & ep : rc.engines)
+		delete ep;
+
+	delete rc.scorer;
+
+	dolog(notice, " * Badank worker finished *");
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	setlog("badank.log", debug, info);
+
+	dolog(notice, " * Badank started *");
+
+	if (argc >= 3 && std::string(argv[1]) == "--worker") {
+		setlog("badank-worker.log", debug, info);
+
+		return run_worker(argv[2], argc >= 4 ? atoi(argv[3]) : 1);
+	}
+
+	std::string cfg_file = argc == 2 ? argv[1] : "badank.cfg";
+
+	std::vector<engine_parameters_t *> eo;  // engine objects
+
+	try {
+		libconfig::Config cfg;
+
+		cfg.readFile(cfg_file.c_str());
+
+		libconfig::Setting & root = cfg.getRoot();
+
+		std::string log_level_screen = (const char *)root.lookup("log_level_screen");
+		std::string log_level_file   = (const char *)root.lookup("log_level_file");
+
+		// ending in .gz or .zst: compressed
+		std::string log_file = "badank.log";
+
+		try {
+			log_file = (const char *)root.lookup("log_file");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		setlog(log_file.c_str(), log_level_file, log_level_screen);
+
+		// the log-file is moved to <log_file>.1 (etc.) when it grows beyond this (in MB)
+		double log_file_max_size = 0.;
+
+		try {
+			log_file_max_size = root.lookup("log_file_max_size");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		int log_file_keep = 5;
+
+		try {
+			log_file_keep = root.lookup("log_file_keep");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		setlogrotate(uint64_t(log_file_max_size * 1024 * 1024), log_file_keep);
+
+		libconfig::Setting & engines = root.lookup("engines");
+		size_t n_engines = engines.getLength();
+
+		for(size_t i=0; i<n_engines; i++) {
+			libconfig::Setting &engine_root = engines[i];
+
+			engine_parameters_t *ep = new engine_parameters_t();
+
+			ep->command   = (const char *)engine_root.lookup("command");
+			ep->directory = (const char *)engine_root.lookup("dir");
+			ep->alt_name  = (const char *)engine_root.lookup("alt_name");
+
+			try {
+				ep->target = engine_root.lookup("target");
+			}
+			catch(const libconfig::SettingNotFoundException & e) {
+				// not a problem, just not set
+				ep->target = false;
+			}
+
+			eo.push_back(ep);
+		}
+
+		std::string scorer_command;
+		std::string scorer_dir;
+
+		try {
+			scorer_command = (const char *)root.lookup("scorer_command");
+			scorer_dir     = (const char *)root.lookup("scorer_dir");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, the built-in board is used
+		}
+
+		bool scorer_crosscheck = false;
+
+		try {
+			scorer_crosscheck = root.lookup("scorer_crosscheck");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		std::string pgn_file = (const char *)root.lookup("pgn_file");
+
+		std::string sgf_file = (const char *)root.lookup("sgf_file");
+
+		int concurrency = root.lookup("concurrency");
+
+		// maximum number of idle processes kept per engine
+		int engine_pool_size = concurrency;
+
+		try {
+			engine_pool_size = root.lookup("engine_pool_size");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		// restart engine processes after this many games (0: never)
+		int engine_recycle_games = 0;
+
+		try {
+			engine_recycle_games = root.lookup("engine_recycle_games");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		int n_games = root.lookup("n_games");
+
+		int dim = root.lookup("board_size");
+
+		time_control_t tc { 0 };
+		tc.main_time       = root.lookup("main_time");
+		tc.byo_yomi_time   = root.lookup("byo_yomi_time");
+		tc.byo_yomi_stones = root.lookup("byo_yomi_stones");
+		tc.constant_time   = root.lookup("constant_time");
+
+		tc.cpu_time             = false;
+		tc.cpu_time_wall_factor = 4.0;
+		tc.genmove_grace        = 5.0;
+
+		try {
+			tc.genmove_grace = root.lookup("genmove_grace");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		// in seconds
+		double command_timeout = 10.0;
+
+		try {
+			command_timeout = root.lookup("command_timeout");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		set_gtp_command_timeout(int(command_timeout * 1000));
+
+		try {
+			tc.cpu_time = root.lookup("cpu_time");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		try {
+			tc.cpu_time_wall_factor = root.lookup("cpu_time_wall_factor");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		if (tc.cpu_time_wall_factor < 1.0)
+			error_exit(false, "cpu_time_wall_factor must be 1.0 or more");
+
+		int n_random_stones = root.lookup("n_random_stones");
+
+		double komi = root.lookup("komi");
+
+		std::string sgf_book_path;
 
-		int nr = 0;
+		try {
+			sgf_book_path = (const char *)root.lookup("sgf_book_path");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-		for(int i=0; i<iterations; i++) {
-			for(auto & target : targets) {
-				for(size_t a=0; a<n; a++) {
-					if (*stop_flag) {
-						dolog(info, "Aborted batching");
-						goto abort_batching;
-					}
+		std::vector<book_entry_t> book_entries;
 
-					if (target == engines[a])
-						continue;
+		if (sgf_book_path.empty() == false)
+			load_sgf_opening_files(sgf_book_path, &book_entries);
 
-					if (engines[a] -> target)
-						continue;
+		// the games of a book entry are played on the board size of that entry
+		bool book_needs_scorer = false;
 
-					q.push({ target, engines[a], nr });
-					nr++;
+		for(auto & be : book_entries) {
+			if (is_board_size_supported(be.dim) == false) {
+				if (scorer_command.empty())
+					error_exit(false, "The opening book contains a game of board size %d, that requires an external scorer (\"scorer_command\")", be.dim);
 
-					q.push({ engines[a], target, nr });
-					nr++;
-				}
+				book_needs_scorer = true;
 			}
 		}
-	}
 
-abort_batching:
-	engine_parameters_t ep;
+		engine_parameters_t scorer_ep { scorer_command, scorer_dir, "" };
+		const engine_parameters_t *scorer = nullptr;
 
-	for(int i=0; i<concurrency; i++)
-		q.push({nullptr, nullptr, -1});
+		if (scorer_command.empty() == false && (scorer_crosscheck || book_needs_scorer || is_board_size_supported(dim) == false))
+			scorer = &scorer_ep;
+		else if (is_board_size_supported(dim) == false)
+			error_exit(false, "Board size %d requires an external scorer (\"scorer_command\")", dim);
 
-    	dolog(info, "Waiting for threads to finish...");
+		// coordinator: workers on other hosts connect to this port to play games
+		int listen_port = 0;
 
-	while(!threads.empty()) {
-		bool joined_any = false;
+		try {
+			listen_port = root.lookup("listen_port");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-		for(auto it = threads.begin(); it != threads.end();) {
-			if ((*it)->joinable()) {
-				(*it)->join();
+		// other hosts are only served when asked for
+		std::string listen_address = "127.0.0.1";
 
-				delete *it;
+		try {
+			listen_address = (const char *)root.lookup("listen_address");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-				it = threads.erase(it);
+		// workers should send this (BADANK_SECRET in their environment)
+		std::string listen_secret;
 
-				joined_any = true;
-			}
-			else {
-				it++;
-			}
+		try {
+			listen_secret = (const char *)root.lookup("listen_secret");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
 		}
 
-		if (joined_any)
-			dolog(info, "%zu threads left", threads.size());
+		if (concurrency < 0 || (concurrency == 0 && listen_port == 0))
+			error_exit(false, "concurrency must be at least 1 (or 0 with listen_port set)");
 
-		usleep(10000);
-	}
+		signal(SIGPIPE, SIG_IGN);
 
-    	dolog(info, "Batch finished");
-}
+		// start the engines for the next game in the queue while a game is played
+		bool prewarm_engines = true;
 
-void test_config(const std::vector<engine_parameters_t *> & eo)
-{
-	bool err = false;
+		try {
+			prewarm_engines = root.lookup("prewarm_engines");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-	dolog(info, "Verifying configuration...");
+		// threads that read from the engines
+		int reactor_threads = 1;
 
-	for(auto ep : eo) {
-		dolog(info, "Trying %s", ep->command.c_str());
+		try {
+			reactor_threads = root.lookup("reactor_threads");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-		GtpEngine *test = new GtpEngine(ep->command, ep->directory, ep->alt_name);
+		// threads that advance the games (and as many that start and end them)
+		int game_threads = 2;
 
-		auto rc = test->protocol_version();
-		if (rc.has_value() == false) {
-			dolog(error, "Cannot talk to: %s", ep->command.c_str());
-			err = true;
+		try {
+			game_threads = root.lookup("game_threads");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
 		}
 
-		delete test;
-	}
+		if (reactor_threads < 1 || game_threads < 1)
+			error_exit(false, "\"reactor_threads\" and \"game_threads\" should be at least 1");
 
-	if (err) {
-		dolog(warning, "Terminating because of error(s)");
-		exit(1);
-	}
-}
+		// when set, 'concurrency' is the maximum and the number of games in
+		// parallel is adjusted to the load of the system
+		int concurrency_min = concurrency;
 
-void sigh(int sig)
-{
-	stop_flag = true;
+		try {
+			concurrency_min = root.lookup("concurrency_min");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-	dolog(notice, "Program termination triggered by ^c (SIGINT)");
-}
+		if (concurrency > 0 && (concurrency_min < 1 || concurrency_min > concurrency))
+			error_exit(false, "concurrency_min must be between 1 and concurrency");
 
-int main(int argc, char *argv[])
-{
-	setlog("badank.log", debug, info);
+		// seconds between adjustments
+		double concurrency_interval = 10.0;
 
-	dolog(notice, " * Badank started *");
+		try {
+			concurrency_interval = root.lookup("concurrency_interval");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-	std::string cfg_file = argc == 2 ? argv[1] : "badank.cfg";
+		// fraction of the time engines may have to wait for a cpu
+		double concurrency_max_delay = 0.05;
 
-	std::vector<engine_parameters_t *> eo;  // engine objects
+		try {
+			concurrency_max_delay = root.lookup("concurrency_max_delay");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-	try {
-		libconfig::Config cfg;
+		ConcurrencyController *cc = nullptr;
 
-		cfg.readFile(cfg_file.c_str());
+		if (concurrency_min < concurrency)
+			cc = new ConcurrencyController(concurrency_min, concurrency, int(concurrency_interval * 1000), concurrency_max_delay);
 
-		libconfig::Setting & root = cfg.getRoot();
+		// pin the engines of each concurrent game to their own set of cpus
+		bool cpu_affinity = false;
 
-		std::string log_level_screen = (const char *)root.lookup("log_level_screen");
-		std::string log_level_file   = (const char *)root.lookup("log_level_file");
+		try {
+			cpu_affinity = root.lookup("cpu_affinity");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-		setlog("badank.log", log_level_file, log_level_screen);
+		// also move the memory of the engines to the NUMA node of those cpus
+		bool numa_bind = false;
 
-		libconfig::Setting & engines = root.lookup("engines");
-		size_t n_engines = engines.getLength();
+		try {
+			numa_bind = root.lookup("numa_bind");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-		for(size_t i=0; i<n_engines; i++) {
-			libconfig::Setting &engine_root = engines[i];
+		Placement *placement = cpu_affinity ? new Placement(concurrency, numa_bind) : nullptr;
 
-			engine_parameters_t *ep = new engine_parameters_t();
+		// stop a match between two engines as soon as the outcome is clear
+		bool   use_sprt   = false;
+		double sprt_elo0  = 0.0;
+		double sprt_elo1  = 0.0;
+		double sprt_alpha = 0.05;
+		double sprt_beta  = 0.05;
 
-			ep->command   = (const char *)engine_root.lookup("command");
-			ep->directory = (const char *)engine_root.lookup("dir");
-			ep->alt_name  = (const char *)engine_root.lookup("alt_name");
+		try {
+			libconfig::Setting & sprt_root = root.lookup("sprt");
+
+			sprt_elo0 = sprt_root.lookup("elo0");
+			sprt_elo1 = sprt_root.lookup("elo1");
 
 			try {
-				ep->target = engine_root.lookup("target");
+				sprt_alpha = sprt_root.lookup("alpha");
+				sprt_beta  = sprt_root.lookup("beta");
 			}
 			catch(const libconfig::SettingNotFoundException & e) {
-				// not a problem, just not set
-				ep->target = false;
+				// not a problem, the defaults are used
 			}
 
-			eo.push_back(ep);
+			use_sprt = true;
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
 		}
 
-		std::string scorer_command = (const char *)root.lookup("scorer_command");
-		std::string scorer_dir = (const char *)root.lookup("scorer_dir");
-		engine_parameters_t scorer { scorer_command, scorer_dir, "" };
+		if (use_sprt) {
+			if (eo.size() != 2)
+				error_exit(false, "SPRT requires exactly two engines");
 
-		std::string pgn_file = (const char *)root.lookup("pgn_file");
+			if (sprt_elo1 <= sprt_elo0)
+				error_exit(false, "SPRT: elo1 must be larger than elo0");
 
-		std::string sgf_file = (const char *)root.lookup("sgf_file");
+			if (sprt_alpha <= 0. || sprt_alpha >= 1. || sprt_beta <= 0. || sprt_beta >= 1.)
+				error_exit(false, "SPRT: alpha and beta must be between 0 and 1");
+		}
 
-		int concurrency = root.lookup("concurrency");
+		// choose the next pairing on what the ratings are expected to learn
+		// from it instead of playing the fixed round-robin/gauntlet order
+		bool dynamic_pairing = false;
 
-		int n_games = root.lookup("n_games");
+		try {
+			dynamic_pairing = std::string((const char *)root.lookup("scheduler")) == "dynamic";
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-		int dim = root.lookup("board_size");
+		// with the dynamic scheduler: games per pairing before it is chosen on information
+		int pairing_min_games = 2;
 
-		time_control_t tc { 0 };
-		tc.main_time       = root.lookup("main_time");
-		tc.byo_yomi_time   = root.lookup("byo_yomi_time");
-		tc.byo_yomi_stones = root.lookup("byo_yomi_stones");
-		tc.constant_time   = root.lookup("constant_time");
+		try {
+			pairing_min_games = root.lookup("pairing_min_games");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-		int n_random_stones = root.lookup("n_random_stones");
+		// with the dynamic scheduler: alternate the colours within a pairing (else random)
+		bool pairing_colour_balance = true;
 
-		double komi = root.lookup("komi");
+		try {
+			pairing_colour_balance = root.lookup("pairing_colour_balance");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
 
-		std::string sgf_book_path;
+		// the games that were finished, so that an interrupted run can be continued
+		std::string journal_file;
 
 		try {
-			sgf_book_path = (const char *)root.lookup("sgf_book_path");
+			journal_file = (const char *)root.lookup("journal_file");
 		}
 		catch(const libconfig::SettingNotFoundException & e) {
 			// not a problem, just not set
 		}
 
-		signal(SIGPIPE, SIG_IGN);
+		// seconds between flushes of the journal to disk
+		double journal_sync_interval = 5.0;
+
+		try {
+			journal_sync_interval = root.lookup("journal_sync_interval");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		// one sgf file per game in this directory (in addition to sgf_file)
+		std::string sgf_dir;
+
+		try {
+			sgf_dir = (const char *)root.lookup("sgf_dir");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		// seconds a finished game may wait for others to be written with it
+		double result_flush_interval = 0.;
+
+		try {
+			result_flush_interval = root.lookup("result_flush_interval");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		// seconds between fsyncs of the pgn/sgf files, 0 for never
+		double result_fsync_interval = 0.;
+
+		try {
+			result_fsync_interval = root.lookup("result_fsync_interval");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		// binary archive of the games, see badank-archive
+		std::string archive_file;
+
+		try {
+			archive_file = (const char *)root.lookup("archive_file");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		// seconds between logging the ratings while the tournament runs, 0 for never
+		double rating_interval = 0.;
+
+		try {
+			rating_interval = root.lookup("rating_interval");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		// virtual games per pair of engines (regularizes small samples)
+		double rating_prior = 2.;
+
+		try {
+			rating_prior = root.lookup("rating_prior");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		if (rating_prior < 0.)
+			error_exit(false, "rating_prior cannot be negative");
+
+		int rating_threads = std::thread::hardware_concurrency();
+
+		try {
+			rating_threads = root.lookup("rating_threads");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		// http server with the progress and statistics, 0 for none
+		int metrics_port = 0;
+
+		try {
+			metrics_port = root.lookup("metrics_port");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		std::string metrics_address = "127.0.0.1";
+
+		try {
+			metrics_address = (const char *)root.lookup("metrics_address");
+		}
+		catch(const libconfig::SettingNotFoundException & e) {
+			// not a problem, just not set
+		}
+
+		if (dynamic_pairing && use_sprt)
+			error_exit(false, "SPRT requires the static scheduler (games are played in pairs with reversed colours)");
+
+		init_reactors(reactor_threads);
 
-		test_config(eo);
+		EnginePool *pool = new EnginePool(engine_pool_size, engine_recycle_games, prewarm_engines);
+
+		test_config(eo, pool);
 
 		signal(SIGINT, sigh);
 
+		signal(SIGUSR1, sigusr1);
+
+		// the target engine (if any) is the one that is tested
+		Sprt *sprt = use_sprt ? new Sprt(eo.at(1)->target && !eo.at(0)->target ? eo.at(1) : eo.at(0), sprt_elo0, sprt_elo1, sprt_alpha, sprt_beta) : nullptr;
+
+		NetListener *listener = listen_port ? new NetListener(listen_address, listen_port) : nullptr;
+
+		if (listener)
+			dolog(info, "Waiting for workers on port %d", listen_port);
+
+		Journal *journal = nullptr;
+
+		if (journal_file.empty() == false) {
+			// a journal is only continued with the same engines and schedule
+			std::string fingerprint = myformat("%d\t%f\t%d\t%d\t%d", dim, komi, n_games, dynamic_pairing, n_random_stones);
+
+			for(auto & ep : eo)
+				fingerprint += "\t" + ep->command + "\t" + ep->directory + "\t" + ep->alt_name + "\t" + (ep->target ? "target" : "");
+
+			journal = new Journal(journal_file, eo, fingerprint, int(journal_sync_interval * 1000));
+		}
+
+		ResultWriter *writer = new ResultWriter(pgn_file, sgf_file, sgf_dir, int(result_flush_interval * 1000), int(result_fsync_interval * 1000), archive_file, journal);
+
+		remote_config_t rc { dim, komi, tc, n_random_stones, command_timeout, sgf_book_path, book_entries.size(), book_checksum(book_entries), scorer, eo, listen_secret };
+
 		stats_t s;
 
-		uint64_t start_ts = get_ts_ms();
-		play_batch(eo, &scorer, dim, pgn_file, sgf_file, concurrency, n_games, &s, tc, komi, n_random_stones, sgf_book_path, &stop_flag);
-		uint64_t end_ts = get_ts_ms();
-		uint64_t took_ts = end_ts - start_ts;
+		s.ratings = new Ratings(eo, rating_prior, rating_threads, int(rating_interval * 1000));
+
+		uint64_t start_ts = get_ts_ns();
+		play_batch(eo, scorer, dim, writer, concurrency, n_games, &s, tc, komi, n_random_stones, &book_entries, &stop_flag, pool, placement, cc, sprt, journal, dynamic_pairing, pairing_min_games, pairing_colour_balance, listener, &rc, metrics_address, metrics_port, game_threads);
+		uint64_t end_ts = get_ts_ns();
+		uint64_t took_ts = (end_ts - start_ts) / 1000000;
+
+		delete listener;
+
+		// the writer still adds to the journal
+		delete writer;
+
+		delete journal;
+
+		pool->log_statistics();
+
+		log_spawn_statistics();
+
+		// terminates the idle engines so that their cpu usage is counted below
+		delete pool;
+
+		stop_reactors();
+
+		delete placement;
+
+		delete cc;
 
 		struct rusage ru;
 		if (getrusage(RUSAGE_CHILDREN, &ru) == -1)
@@ -874,11 +2830,35 @@ int main(int argc, char *argv[])
 		uint64_t child_ts = ru.ru_utime.tv_sec * 1000 + ru.ru_utime.tv_usec / 1000;
 
 		dolog(info, "Time used: %fs, cpu factor child processes: %f", took_ts / 1000.0, child_ts / double(took_ts));
-		int g_ok = s.ok, g_error = s.error;
+		int g_ok = s.ok, g_error = s.error, g_timeout = s.timeout;
 		uint64_t g_ok_took = s.ok_took;
-		dolog(info, "Games ok: %d (avg duration: %.1fs), games with an error: %d", g_ok, g_ok_took / 1000.0 / g_ok, g_error);
+		dolog(info, "Games ok: %d (avg duration: %.1fs), games with an error: %d, games with a hung engine: %d", g_ok, g_ok_took / 1e9 / g_ok, g_error, g_timeout);
+
+		uint64_t g_play_ns = s.play_ns, g_think_ns = s.think_ns;
+		if (g_play_ns)
+			dolog(info, "Engines were thinking %.1f%% of the time, badank overhead: %.3fs", g_think_ns * 100. / g_play_ns, (g_play_ns - std::min(g_play_ns, g_think_ns)) / 1e9);
+
+		if (sprt) {
+			sprt->log_summary();
+
+			delete sprt;
+		}
+
+		s.ratings->update();
+
+		s.ratings->log_table(true);
+
+		delete s.ratings;
+
+		std::vector<std::pair<std::string, const engine_latency_t *> > latencies;
+
+		for(auto ep : eo)
+			latencies.push_back({ ep->name, &ep->latency });
+
+		log_latency_report(latencies, tc.constant_time ? 0. : tc.main_time);
 
-		dolog(info, "ratings:");
+		// incremental, depends on the order in which the games finished
+		dolog(info, "glicko-2 ratings:");
 		for(engine_parameters_t *ep : eo) {
 			dolog(info, "%s: %.1f elo", ep->name.c_str(), ep->rating.Rating1());
 
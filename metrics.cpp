@@ -0,0 +1,220 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log.h"
+#include "metrics.h"
+#include "net.h"
+#include "str.h"
+
+
+MetricsServer::MetricsServer(const std::string & address, const int port, const std::function<std::vector<metric_t>()> & collect) :
+	listener(new NetListener(address, port)),
+	collect(collect)
+{
+	dolog(info, "Metrics on http://%s:%d/metrics", address.empty() ? "*" : address.c_str(), port);
+
+	th = new std::thread(&MetricsServer::run, this);
+}
+
+MetricsServer::~MetricsServer()
+{
+	stop = true;
+
+	th->join();
+	delete th;
+
+	delete listener;
+}
+
+void MetricsServer::run()
+{
+	while(!stop) {
+		NetConnection *c = listener->accept_connection(500);
+
+		if (c) {
+			handle(c);
+
+			delete c;
+		}
+	}
+}
+
+void MetricsServer::handle(NetConnection *const c)
+{
+	// a client that does not send its request in time is dropped
+	auto request = c->read_line(&stop, 5000);
+
+	if (request.has_value() == false)
+		return;
+
+	for(;;) {  // the headers are not used
+		auto header = c->read_line(&stop, 5000);
+
+		if (header.has_value() == false)
+			return;
+
+		if (header.value().empty() || header.value() == "\r")
+			break;
+	}
+
+	auto parts = split_fields(request.value(), ' ');
+
+	std::string status = "200 OK";
+	std::string type   = "text/plain; charset=utf-8";
+	std::string body;
+
+	if (parts.size() < 2 || parts.at(0) != "GET") {
+		status = "405 Method Not Allowed";
+		body   = "only GET is supported\n";
+	}
+	else if (parts.at(1) == "/metrics") {
+		type = "text/plain; version=0.0.4; charset=utf-8";
+		body = metrics_to_text(collect());
+	}
+	else if (parts.at(1) == "/metrics.json") {
+		type = "application/json";
+		body = metrics_to_json(collect());
+	}
+	else {
+		status = "404 Not Found";
+		body   = "see /metrics or /metrics.json\n";
+	}
+
+	dolog(debug, "Metrics: \"%s\" from %s: %s", request.value().c_str(), c->get_peer().c_str(), status.c_str());
+
+	c->send_data(myformat("HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", status.c_str(), type.c_str(), body.size()) + body);
+}
+
+static std::string format_value(const double v, const bool json)
+{
+	if (std::isnan(v))
+		return json ? "null" : "NaN";
+
+	if (std::isinf(v))
+		return json ? "null" : (v > 0 ? "+Inf" : "-Inf");
+
+	if (v == floor(v) && fabs(v) < 1e15)
+		return myformat("%.0f", v);
+
+	return myformat("%.9g", v);
+}
+
+// the same for label values in the text format and for json strings
+static std::string escape(const std::string & in)
+{
+	std::string out;
+
+	for(char c : in) {
+		if (c == '\\' || c == '"')
+			out += std::string("\\") + c;
+		else if (c == '\n')
+			out += "\\n";
+		else if ((unsigned char)c < 32)
+			out += myformat("\\u%04x", c);
+		else
+			out += c;
+	}
+
+	return out;
+}
+
+std::string metrics_to_text(const std::vector<metric_t> & metrics)
+{
+	std::string out;
+	std::string family;
+
+	for(auto & m : metrics) {
+		// the _sum and _count of a summary belong to it
+		bool same = m.name == family || (m.type == "summary" && (m.name == family + "_sum" || m.name == family + "_count"));
+
+		if (same == false) {
+			family = m.name;
+
+			out += "# HELP " + m.name + " " + m.help + "\n";
+			out += "# TYPE " + m.name + " " + m.type + "\n";
+		}
+
+		out += m.name;
+
+		if (m.labels.empty() == false) {
+			out += "{";
+
+			for(size_t i=0; i<m.labels.size(); i++)
+				out += myformat("%s%s=\"%s\"", i ? "," : "", m.labels.at(i).first.c_str(), escape(m.labels.at(i).second).c_str());
+
+			out += "}";
+		}
+
+		out += " " + format_value(m.value, false) + "\n";
+	}
+
+	return out;
+}
+
+// { "name": value, "labelled-name": [ { "label": "...", "value": value }, ... ] }
+std::string metrics_to_json(const std::vector<metric_t> & metrics)
+{
+	std::vector<std::string>              order;
+	std::vector<std::vector<std::string> > entries;
+	std::vector<bool>                     labelled;
+
+	for(auto & m : metrics) {
+		size_t i = 0;
+
+		while(i < order.size() && order.at(i) != m.name)
+			i++;
+
+		if (i == order.size()) {
+			order.push_back(m.name);
+			entries.push_back({ });
+			labelled.push_back(false);
+		}
+
+		if (m.labels.empty()) {
+			entries.at(i).push_back(format_value(m.value, true));
+
+			continue;
+		}
+
+		labelled.at(i) = true;
+
+		std::string entry = "{ ";
+
+		for(auto & l : m.labels)
+			entry += "\"" + escape(l.first) + "\": \"" + escape(l.second) + "\", ";
+
+		entry += "\"value\": " + format_value(m.value, true) + " }";
+
+		entries.at(i).push_back(entry);
+	}
+
+	std::string out = "{\n";
+
+	for(size_t i=0; i<order.size(); i++) {
+		out += "  \"" + escape(order.at(i)) + "\": ";
+
+		if (labelled.at(i) || entries.at(i).size() > 1) {
+			out += "[ ";
+
+			for(size_t j=0; j<entries.at(i).size(); j++)
+				out += (j ? ", " : "") + entries.at(i).at(j);
+
+			out += " ]";
+		}
+		else
+			out += entries.at(i).at(0);
+
+		out += i + 1 < order.size() ? ",\n" : "\n";
+	}
+
+	out += "}\n";
+
+	return out;
+}
@@ -0,0 +1,47 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "net.h"
+
+
+typedef struct {
+	std::string name;  // e.g. "badank_games_completed_total"
+	std::string type;  // "counter", "gauge" or "summary"
+	std::string help;
+	std::vector<std::pair<std::string, std::string> > labels;
+	double value;
+} metric_t;
+
+// serves what 'collect' returns over http: "/metrics" in the text format of
+// Prometheus and "/metrics.json". One request at a time, from a thread of its
+// own; 'collect' should only read counters so that it never waits for the
+// threads that play the games.
+class MetricsServer
+{
+private:
+	NetListener *const listener;
+	const std::function<std::vector<metric_t>()> collect;
+
+	std::atomic_bool stop { false };
+	std::thread     *th   { nullptr };
+
+	void run();
+	void handle(NetConnection *const c);
+
+public:
+	// terminates the program when it cannot listen on the port
+	MetricsServer(const std::string & address, const int port, const std::function<std::vector<metric_t>()> & collect);
+	~MetricsServer();
+};
+
+std::string metrics_to_text(const std::vector<metric_t> & metrics);
+std::string metrics_to_json(const std::vector<metric_t> & metrics);
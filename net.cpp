@@ -0,0 +1,256 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <atomic>
+#include <errno.h>
+#include <netdb.h>
+#include <optional>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "error.h"
+#include "log.h"
+#include "net.h"
+#include "str.h"
+#include "time.h"
+
+
+// a worker that disappears without closing the connection (power failure,
+// network cable) is noticed after about a minute, also during long games
+static void set_keepalive(const int fd)
+{
+	int on = 1;
+	setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof on);
+
+	int idle = 30, interval = 10, count = 3;
+	setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE,  &idle,     sizeof idle);
+	setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof interval);
+	setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT,   &count,    sizeof count);
+
+	// results are small and should not wait for more data
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+}
+
+static std::string describe_address(const sockaddr *const a, const socklen_t len)
+{
+	char host[NI_MAXHOST] { 0 };
+	char port[NI_MAXSERV] { 0 };
+
+	if (getnameinfo(a, len, host, sizeof host, port, sizeof port, NI_NUMERICHOST | NI_NUMERICSERV))
+		return "?";
+
+	if (a->sa_family == AF_INET6)
+		return myformat("[%s]:%s", host, port);
+
+	return myformat("%s:%s", host, port);
+}
+
+NetConnection::NetConnection(const int fd, const std::string & peer) : fd(fd), peer(peer)
+{
+	set_keepalive(fd);
+}
+
+NetConnection::~NetConnection()
+{
+	close(fd);
+}
+
+NetConnection *NetConnection::connect_to(const std::string & host, const int port)
+{
+	addrinfo hints { };
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo *result = nullptr;
+
+	int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
+	if (rc) {
+		dolog(error, "Cannot resolve %s: %s", host.c_str(), gai_strerror(rc));
+
+		return nullptr;
+	}
+
+	NetConnection *out = nullptr;
+
+	for(addrinfo *cur = result; cur; cur = cur->ai_next) {
+		int fd = socket(cur->ai_family, cur->ai_socktype | SOCK_CLOEXEC, cur->ai_protocol);
+		if (fd == -1)
+			continue;
+
+		if (connect(fd, cur->ai_addr, cur->ai_addrlen) == 0) {
+			out = new NetConnection(fd, describe_address(cur->ai_addr, cur->ai_addrlen));
+			break;
+		}
+
+		close(fd);
+	}
+
+	freeaddrinfo(result);
+
+	if (out == nullptr)
+		dolog(error, "Cannot connect to %s port %d: %s", host.c_str(), port, strerror(errno));
+
+	return out;
+}
+
+bool NetConnection::send_line(const std::string & line)
+{
+	return send_data(line + "\n");
+}
+
+bool NetConnection::send_data(const std::string & data)
+{
+	const char *p   = data.c_str();
+	size_t      len = data.size();
+
+	while(len > 0) {
+		ssize_t rc = send(fd, p, len, MSG_NOSIGNAL);
+
+		if (rc == -1 && errno == EINTR)
+			continue;
+
+		if (rc <= 0) {
+			dolog(warning, "Cannot send to %s: %s", peer.c_str(), strerror(errno));
+
+			return false;
+		}
+
+		p   += rc;
+		len -= rc;
+	}
+
+	return true;
+}
+
+std::optional<std::string> NetConnection::read_line(std::atomic_bool *const stop_flag, const int timeout_ms)
+{
+	uint64_t deadline = timeout_ms >= 0 ? get_ts_ms() + timeout_ms : 0;
+
+	for(;;) {
+		size_t lf = buffer.find('\n');
+
+		if (lf != std::string::npos) {
+			std::string line = buffer.substr(0, lf);
+
+			buffer.erase(0, lf + 1);
+
+			return line;
+		}
+
+		pollfd fds[] { { fd, POLLIN, 0 } };
+
+		// wake up now and then to see if we should stop
+		int rc = poll(fds, 1, 500);
+
+		if (stop_flag && *stop_flag)
+			return { };
+
+		if (deadline && get_ts_ms() >= deadline)
+			return { };
+
+		if (rc == 0 || (rc == -1 && errno == EINTR))
+			continue;
+
+		if (rc == -1)
+			return { };
+
+		char temp[4096];
+
+		ssize_t n = recv(fd, temp, sizeof temp, 0);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return { };
+
+		buffer.append(temp, n);
+	}
+}
+
+NetListener::NetListener(const std::string & address, const int port)
+{
+	addrinfo hints { };
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags    = AI_PASSIVE;
+
+	addrinfo *result = nullptr;
+
+	int rc = getaddrinfo(address.empty() ? nullptr : address.c_str(), std::to_string(port).c_str(), &hints, &result);
+	if (rc)
+		error_exit(false, "Cannot resolve \"%s\": %s", address.c_str(), gai_strerror(rc));
+
+	for(addrinfo *cur = result; cur; cur = cur->ai_next) {
+		fd = socket(cur->ai_family, cur->ai_socktype | SOCK_CLOEXEC, cur->ai_protocol);
+		if (fd == -1)
+			continue;
+
+		int on = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+
+		if (bind(fd, cur->ai_addr, cur->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0)
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(result);
+
+	if (fd == -1)
+		error_exit(true, "Cannot listen on port %d", port);
+}
+
+NetListener::~NetListener()
+{
+	close(fd);
+}
+
+NetConnection *NetListener::accept_connection(const int timeout_ms)
+{
+	pollfd fds[] { { fd, POLLIN, 0 } };
+
+	if (poll(fds, 1, timeout_ms) != 1)
+		return nullptr;
+
+	sockaddr_storage a { };
+	socklen_t        len = sizeof a;
+
+	int cfd = accept4(fd, reinterpret_cast<sockaddr *>(&a), &len, SOCK_CLOEXEC);
+	if (cfd == -1) {
+		dolog(warning, "accept failed: %s", strerror(errno));
+
+		return nullptr;
+	}
+
+	return new NetConnection(cfd, describe_address(reinterpret_cast<sockaddr *>(&a), len));
+}
+
+void split_host_port(const std::string & in, const int default_port, std::string *const host, int *const port)
+{
+	*port = default_port;
+
+	size_t colon = in.rfind(':');
+
+	// "[::1]:2300" or "host:2300", but not "::1"
+	if (colon != std::string::npos && (in.find(':') == colon || (in.at(0) == '[' && colon > 0 && in.at(colon - 1) == ']'))) {
+		*host = in.substr(0, colon);
+		*port = atoi(in.substr(colon + 1).c_str());
+	}
+	else {
+		*host = in;
+	}
+
+	if (host->size() >= 2 && host->at(0) == '[' && host->back() == ']')
+		*host = host->substr(1, host->size() - 2);
+}
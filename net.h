@@ -0,0 +1,57 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <string>
+
+
+// a line based tcp connection between a coordinator and a worker
+class NetConnection
+{
+private:
+	const int         fd;
+	const std::string peer;
+
+	std::string buffer;  // received, not returned by read_line() yet
+
+public:
+	NetConnection(const int fd, const std::string & peer);
+	~NetConnection();
+
+	// nullptr when the host cannot be reached
+	static NetConnection *connect_to(const std::string & host, const int port);
+
+	std::string get_peer() const { return peer; }
+
+	// to wait (poll) for a request; a line that was received with an
+	// earlier one is not seen by poll, see has_line()
+	int get_fd() const { return fd; }
+	bool has_line() const { return buffer.find('\n') != std::string::npos; }
+
+	bool send_line(const std::string & line);
+	bool send_data(const std::string & data);
+
+	// without the newline; nothing when the peer disconnected, when
+	// stop_flag was set or after 'timeout_ms' (-1: no timeout)
+	std::optional<std::string> read_line(std::atomic_bool *const stop_flag, const int timeout_ms = -1);
+};
+
+class NetListener
+{
+private:
+	int fd { -1 };
+
+public:
+	// terminates the program when it cannot listen on the port
+	NetListener(const std::string & address, const int port);
+	~NetListener();
+
+	// nullptr when nobody connected within 'timeout_ms'
+	NetConnection *accept_connection(const int timeout_ms);
+};
+
+// "host" or "host:port"
+void split_host_port(const std::string & in, const int default_port, std::string *const host, int *const port);
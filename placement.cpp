@@ -0,0 +1,216 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <map>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/syscall.h>
+
+#include "error.h"
+#include "log.h"
+#include "placement.h"
+#include "str.h"
+
+
+// "0-3,8,10-11"
+static std::vector<int> parse_cpu_list(const std::string & in)
+{
+	std::vector<int> out;
+
+	for(auto & part : split(trim(in, " \n"), ",")) {
+		std::size_t dash = part.find('-');
+
+		int first = atoi(part.c_str());
+		int last  = dash == std::string::npos ? first : atoi(part.substr(dash + 1).c_str());
+
+		for(int cpu=first; cpu<=last; cpu++)
+			out.push_back(cpu);
+	}
+
+	return out;
+}
+
+static std::string cpu_list_to_string(const std::vector<int> & cpus)
+{
+	std::string out;
+
+	for(size_t i=0; i<cpus.size();) {
+		size_t j = i;
+
+		while(j + 1 < cpus.size() && cpus.at(j + 1) == cpus.at(j) + 1)
+			j++;
+
+		if (out.empty() == false)
+			out += ",";
+
+		if (j == i)
+			out += myformat("%d", cpus.at(i));
+		else
+			out += myformat("%d-%d", cpus.at(i), cpus.at(j));
+
+		i = j + 1;
+	}
+
+	return out;
+}
+
+// cpu -> NUMA node; empty when the system does not expose it
+static std::map<int, int> get_cpu_nodes()
+{
+	std::map<int, int> out;
+
+	DIR *dir = opendir("/sys/devices/system/node");
+	if (!dir)
+		return out;
+
+	while(dirent *entry = readdir(dir)) {
+		if (strncmp(entry->d_name, "node", 4) != 0 || !isdigit(entry->d_name[4]))
+			continue;
+
+		int node = atoi(&entry->d_name[4]);
+
+		FILE *fh = fopen(myformat("/sys/devices/system/node/%s/cpulist", entry->d_name).c_str(), "r");
+		if (!fh)
+			continue;
+
+		char buffer[4096] { 0 };
+		if (fgets(buffer, sizeof buffer, fh)) {
+			for(int cpu : parse_cpu_list(buffer))
+				out.insert({ cpu, node });
+		}
+
+		fclose(fh);
+	}
+
+	closedir(dir);
+
+	return out;
+}
+
+Placement::Placement(const int n_slots, const bool bind_memory) : bind_memory(bind_memory)
+{
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+
+	// respects taskset, cgroup cpusets and such
+	if (sched_getaffinity(0, sizeof allowed, &allowed) == -1)
+		error_exit(true, "sched_getaffinity failed");
+
+	auto cpu_nodes = get_cpu_nodes();
+
+	std::vector<int> cpus;
+
+	for(int cpu=0; cpu<CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &allowed))
+			cpus.push_back(cpu);
+	}
+
+	// cpus of the same node next to each other: slots then stay within a node where possible
+	auto node_of = [&cpu_nodes](const int cpu) { auto it = cpu_nodes.find(cpu); return it == cpu_nodes.end() ? 0 : it->second; };
+
+	std::stable_sort(cpus.begin(), cpus.end(), [&node_of](const int a, const int b) { return node_of(a) < node_of(b); });
+
+	const int n_cpus = cpus.size();
+
+	for(int slot=0; slot<n_slots; slot++) {
+		std::vector<int> slot_cpus;
+
+		if (n_slots >= n_cpus) {  // more games than cpus: they have to share
+			slot_cpus.push_back(cpus.at(slot % n_cpus));
+		}
+		else {
+			int first = slot * n_cpus / n_slots;
+			int last  = (slot + 1) * n_cpus / n_slots;
+
+			for(int i=first; i<last; i++)
+				slot_cpus.push_back(cpus.at(i));
+		}
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+
+		int node = node_of(slot_cpus.at(0));
+
+		for(int cpu : slot_cpus) {
+			CPU_SET(cpu, &set);
+
+			if (node_of(cpu) != node)
+				node = -1;
+		}
+
+		if (cpu_nodes.empty())
+			node = -1;
+
+		std::sort(slot_cpus.begin(), slot_cpus.end());
+
+		slots.push_back(set);
+		slot_node.push_back(node);
+		descriptions.push_back(myformat("cpus %s", cpu_list_to_string(slot_cpus).c_str()) + (node == -1 ? "" : myformat(", node %d", node)));
+
+		dolog(info, "Slot %d: %s", slot, descriptions.back().c_str());
+	}
+}
+
+bool Placement::apply(const int slot, const pid_t pid) const
+{
+	if (pid <= 0)
+		return false;
+
+	const cpu_set_t & set = slots.at(slot);
+
+	bool ok = true;
+
+	// sched_setaffinity only affects one thread: do all of them (e.g. a JVM)
+	DIR *dir = opendir(myformat("/proc/%d/task", pid).c_str());
+
+	if (dir) {
+		while(dirent *entry = readdir(dir)) {
+			pid_t tid = atoi(entry->d_name);
+
+			if (tid > 0 && sched_setaffinity(tid, sizeof set, &set) == -1 && errno != ESRCH) {
+				dolog(warning, "Cannot set cpu affinity of thread %d of process %d: %s", tid, pid, strerror(errno));
+				ok = false;
+			}
+		}
+
+		closedir(dir);
+	}
+	else if (sched_setaffinity(pid, sizeof set, &set) == -1) {
+		dolog(warning, "Cannot set cpu affinity of process %d: %s", pid, strerror(errno));
+		ok = false;
+	}
+
+	int node = slot_node.at(slot);
+
+	if (bind_memory && node >= 0) {
+		constexpr int max_nodes = 1024;
+		constexpr int bits      = sizeof(unsigned long) * 8;
+
+		unsigned long from[max_nodes / bits];
+		unsigned long to  [max_nodes / bits] { 0 };
+
+		memset(from, 0xff, sizeof from);
+		to[node / bits] = 1ul << (node % bits);
+
+		// new allocations follow the cpus (local node), this moves what was already allocated
+		if (syscall(SYS_migrate_pages, pid, max_nodes, from, to) == -1) {
+			dolog(warning, "Cannot move memory of process %d to node %d: %s", pid, node, strerror(errno));
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+std::string Placement::describe(const int slot) const
+{
+	return descriptions.at(slot);
+}
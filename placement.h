@@ -0,0 +1,32 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <sched.h>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+
+// divides the cpus badank may use into one slot per concurrent game, the
+// processes of a game are then pinned to the cpus of its slot
+class Placement
+{
+private:
+	std::vector<cpu_set_t> slots;
+	std::vector<int>       slot_node;  // NUMA node of a slot, -1 if it spans nodes
+	std::vector<std::string> descriptions;
+	const bool             bind_memory;
+
+public:
+	Placement(const int n_slots, const bool bind_memory);
+
+	size_t get_n_slots() const { return slots.size(); }
+
+	// pins all threads of the process to the slot (and moves its memory to the
+	// NUMA node of the slot when bind_memory is set)
+	bool apply(const int slot, const pid_t pid) const;
+
+	std::string describe(const int slot) const;
+};
@@ -0,0 +1,153 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "engine.h"
+#include "gtp.h"
+#include "log.h"
+#include "pool.h"
+
+
+EnginePool::EnginePool(const int max_idle, const int recycle_after, const bool allow_prewarm) :
+	max_idle(max_idle),
+	recycle_after(recycle_after),
+	allow_prewarm(allow_prewarm)
+{
+}
+
+EnginePool::~EnginePool()
+{
+	for(auto & it : idle) {
+		for(auto & ie : it.second)
+			delete ie.e;
+	}
+}
+
+GtpEngine *EnginePool::get(const engine_parameters_t *const ep)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	auto it = idle.find(ep);
+
+	if (it != idle.end() && it->second.empty() == false) {
+		// prefer the ones that are fully started
+		auto ie = it->second.begin();
+
+		for(auto cur = it->second.begin(); cur != it->second.end(); cur++) {
+			if (cur->handshake_id.has_value() == false) {
+				ie = cur;
+				break;
+			}
+		}
+
+		idle_engine_t entry = *ie;
+		it->second.erase(ie);
+
+		n_reused++;
+
+		lck.unlock();
+
+		if (entry.handshake_id.has_value() == false)
+			return entry.e;
+
+		// 30s startup time max., like protocol_version()
+		if (entry.e->wait(entry.handshake_id.value(), 30000).has_value())
+			return entry.e;
+
+		dolog(warning, "Pre-warmed instance of %s did not start", ep->command.c_str());
+
+		delete entry.e;
+
+		lck.lock();
+	}
+
+	n_started++;
+
+	lck.unlock();
+
+	// start outside of the lock: some engines take a while
+	return new GtpEngine(ep->command, ep->directory, ep->alt_name);
+}
+
+void EnginePool::prewarm(const engine_parameters_t *const ep, const int n)
+{
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> lck(lock);
+
+			if (allow_prewarm == false || int(idle[ep].size()) + warming[ep] >= std::min(n, max_idle))
+				return;
+
+			warming[ep]++;
+
+			n_started++;
+			n_prewarmed++;
+		}
+
+		dolog(debug, "Pre-warming %s", ep->command.c_str());
+
+		// starting is fast (posix_spawn), the engine initializes while the
+		// handshake is pending: nobody waits for it here
+		GtpEngine *e = new GtpEngine(ep->command, ep->directory, ep->alt_name);
+
+		auto id = e->send("protocol_version");
+
+		std::unique_lock<std::mutex> lck(lock);
+
+		warming[ep]--;
+
+		if (id.has_value() == false) {
+			lck.unlock();
+
+			delete e;
+
+			return;
+		}
+
+		idle[ep].push_back({ e, id });
+	}
+}
+
+void EnginePool::put(const engine_parameters_t *const ep, GtpEngine *const e, const bool reusable)
+{
+	e->add_game();
+
+	bool keep = reusable && max_idle > 0;
+
+	if (keep && recycle_after > 0 && e->get_n_games() >= recycle_after) {
+		dolog(debug, "Recycling %s after %d games", e->getname().c_str(), recycle_after);
+
+		keep = false;
+	}
+
+	if (keep && e->has_ended()) {
+		dolog(warning, "%s terminated, not re-using it", e->getname().c_str());
+
+		keep = false;
+	}
+
+	// no clear_board here: every game starts with one (see Game::start)
+	if (keep) {
+		std::unique_lock<std::mutex> lck(lock);
+
+		auto & list = idle[ep];
+
+		if (list.size() < size_t(max_idle)) {
+			list.push_back({ e, { } });
+
+			return;
+		}
+	}
+
+	delete e;
+}
+
+void EnginePool::log_statistics()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	dolog(info, "Engine pool: %d processes started (%d of them pre-warmed), %d times an idle engine was used", n_started, n_prewarmed, n_reused);
+}
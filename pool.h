@@ -0,0 +1,49 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "engine.h"
+#include "gtp.h"
+
+
+// keeps engine processes running between games so that not every game
+// pays for a fork/exec and the startup of the engine
+class EnginePool
+{
+private:
+	const int max_idle;       // per engine
+	const int recycle_after;  // restart an engine after this many games, 0 = never
+	const bool allow_prewarm;
+
+	typedef struct {
+		GtpEngine          *e;
+		std::optional<int>  handshake_id;  // set for pre-warmed engines that may still be starting
+	} idle_engine_t;
+
+	std::mutex lock;
+	std::map<const engine_parameters_t *, std::vector<idle_engine_t> > idle;
+	std::map<const engine_parameters_t *, int> warming;
+
+	int n_started   { 0 };
+	int n_reused    { 0 };
+	int n_prewarmed { 0 };
+
+public:
+	EnginePool(const int max_idle, const int recycle_after, const bool allow_prewarm);
+	~EnginePool();
+
+	GtpEngine *get(const engine_parameters_t *const ep);
+	// starts engines in the background until 'n' are idle (or starting), so
+	// that the next get()s do not have to wait for them to start
+	void prewarm(const engine_parameters_t *const ep, const int n);
+	// 'reusable' should be false when the engine may be in an unknown state
+	void put(const engine_parameters_t *const ep, GtpEngine *const e, const bool reusable);
+
+	void log_statistics();
+};
@@ -1,22 +1,28 @@
 // (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
 // Released under MIT license
 
+#include <algorithm>
+#include <atomic>
 #include <errno.h>
 #include <fcntl.h>
-#include <poll.h>
+#include <functional>
 #include <signal.h>
+#include <spawn.h>
 #include <string>
 #include <string.h>
+#include <string_view>
 #include <tuple>
 #include <unistd.h>
 #include <vector>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
 #include "error.h"
 #include "log.h"
 #include "proc.h"
+#include "reactor.h"
 #include "str.h"
 #include "time.h"
 
@@ -38,46 +44,128 @@ int WRITE(int fd, const char *whereto, size_t len)
 	return cnt;
 }
 
+extern char **environ;
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 34)
+#define HAVE_SPAWN_CLOSEFROM
+#endif
+
+static std::atomic_uint64_t spawn_count    { 0 };
+static std::atomic_uint64_t spawn_took_ns  { 0 };
+static std::atomic_uint64_t spawn_max_ns   { 0 };
+
+#ifndef HAVE_SPAWN_CLOSEFROM
+// only async-signal-safe calls here: this runs between fork() and exec()
+static void close_from(const int first)
+{
+#ifdef SYS_close_range
+	if (syscall(SYS_close_range, first, ~0u, 0) == 0)
+		return;
+#endif
+
+	int fd_max = sysconf(_SC_OPEN_MAX);
+	for(int fd=first; fd<fd_max; fd++)
+		close(fd);
+}
+#endif
+
+// returns -1 as pid when the program could not be started
 std::tuple<pid_t, int, int> exec_with_pipe(const std::string & command, const std::string & dir)
 {
 	int pipe_to_proc[2], pipe_from_proc[2];
 
-	pipe(pipe_to_proc);
-	pipe(pipe_from_proc);
+	// O_CLOEXEC: other games starting engines at the same time must not inherit these
+	if (pipe2(pipe_to_proc, O_CLOEXEC) == -1 || pipe2(pipe_from_proc, O_CLOEXEC) == -1)
+		error_exit(true, "Cannot create pipes for %s", command.c_str());
+
+	std::vector<std::string> parts = split_command(command);
+
+	if (parts.empty())
+		error_exit(false, "No command given");
+
+	// everything is prepared before the child is started: no allocations in the child
+	std::vector<char *> pars;
+	for(auto & part : parts)
+		pars.push_back(const_cast<char *>(part.c_str()));
+	pars.push_back(nullptr);
+
+	uint64_t start_ns = get_ts_ns();
 
-	pid_t pid = fork();
+	pid_t pid = -1;
+
+#ifdef HAVE_SPAWN_CLOSEFROM
+	posix_spawn_file_actions_t fa;
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_adddup2(&fa, pipe_to_proc[0], 0);
+	posix_spawn_file_actions_adddup2(&fa, pipe_from_proc[1], 1);
+	posix_spawn_file_actions_addopen(&fa, 2, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_addclosefrom_np(&fa, 3);
+
+	if (dir.empty() == false)
+		posix_spawn_file_actions_addchdir_np(&fa, dir.c_str());
+
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+
+	sigset_t no_signals, default_signals;
+	sigemptyset(&no_signals);
+	sigemptyset(&default_signals);
+	sigaddset(&default_signals, SIGPIPE);  // ignored by badank itself
+	sigaddset(&default_signals, SIGINT);
+
+	posix_spawnattr_setsigmask(&attr, &no_signals);
+	posix_spawnattr_setsigdefault(&attr, &default_signals);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	// glibc implements this with clone(CLONE_VM | CLONE_VFORK): no copying of page tables
+	int rc = posix_spawn(&pid, pars[0], &fa, &attr, pars.data(), environ);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&fa);
+
+	if (rc != 0) {
+		dolog(error, "Failed to invoke %s: %s", command.c_str(), strerror(rc));
+
+		pid = -1;
+	}
+#else
+	pid = fork();
 	if (pid == 0) {
 		setsid();
 
+		signal(SIGPIPE, SIG_DFL);
+
 		if (dir.empty() == false && chdir(dir.c_str()) == -1)
-			dolog(warning, "chdir to %s for %s failed: %s", dir.c_str(), command.c_str(), strerror(errno));
+			_exit(127);
+
+		dup2(pipe_to_proc[0], 0);
+		dup2(pipe_from_proc[1], 1);
+
+		int null_fd = open("/dev/null", O_WRONLY);
+		dup2(null_fd, 2);
 
-		close(0);
+		close_from(3);
 
-		dup(pipe_to_proc[0]);
-		close(pipe_to_proc[1]);
-		close(1);
-		close(2);
-		dup(pipe_from_proc[1]);
-		open("/dev/null", O_WRONLY);
-		close(pipe_from_proc[0]);
+		execv(pars[0], pars.data());
+
+		_exit(127);
+	}
 
-		int fd_max = sysconf(_SC_OPEN_MAX);
-		for(int fd=3; fd<fd_max; fd++)
-			close(fd);
+	if (pid == -1)
+		dolog(error, "Failed to invoke %s: %s", command.c_str(), strerror(errno));
+#endif
 
-		std::vector<std::string> parts = split(command, " ");
+	uint64_t took_ns = get_ts_ns() - start_ns;
 
-		size_t n_args = parts.size();
-		char **pars = new char *[n_args + 1];
-		for(size_t i=0; i<n_args; i++)
-			pars[i] = (char *)parts.at(i).c_str();
-		pars[n_args] = nullptr;
+	spawn_count++;
+	spawn_took_ns += took_ns;
 
-		if (execv(pars[0], &pars[0]) == -1)
-			error_exit(true, "Failed to invoke %s", command.c_str());
+	uint64_t cur_max = spawn_max_ns;
+	while(took_ns > cur_max && !spawn_max_ns.compare_exchange_weak(cur_max, took_ns)) {
 	}
 
+	dolog(debug, "Starting \"%s\" took %.3f ms", command.c_str(), took_ns / 1000000.);
+
 	close(pipe_to_proc[0]);
 	close(pipe_from_proc[1]);
 
@@ -86,7 +174,17 @@ std::tuple<pid_t, int, int> exec_with_pipe(const std::string & command, const st
 	return out;
 }
 
-TextProgram::TextProgram(const std::string & command, const std::string & dir)
+void log_spawn_statistics()
+{
+	uint64_t n = spawn_count;
+
+	if (n)
+		dolog(info, "Engine processes started: %lu, average start latency: %.3f ms, maximum: %.3f ms", n, spawn_took_ns / 1000000. / n, spawn_max_ns / 1000000.);
+}
+
+TextProgram::TextProgram(const std::string & command, const std::string & dir, const std::function<void(std::optional<std::string_view>)> & line_handler) :
+	line_handler(line_handler),
+	buffer(16384)
 {
 	auto prc = exec_with_pipe(command, dir);
 
@@ -95,14 +193,38 @@ TextProgram::TextProgram(const std::string & command, const std::string & dir)
 	r = std::get<2>(prc);
 
 	dolog(debug, "Started \"%s\" with pid %d", command.c_str(), pid);
+
+	clockid_t clock_id;
+
+	if (pid != -1 && clock_getcpuclockid(pid, &clock_id) == 0)
+		cpu_clock = clock_id;
+
+	// the reactor reads whatever is available, it must not block on it
+	if (fcntl(r, F_SETFL, fcntl(r, F_GETFL) | O_NONBLOCK) == -1)
+		error_exit(true, "fcntl(O_NONBLOCK) failed");
+
+	reactor = get_reactor();
+	reactor->add(r, this);
 }
 
 TextProgram::~TextProgram()
 {
+	if (pid == -1) {
+		reactor->remove(r, this);
+
+		close(r);
+		close(w);
+
+		return;
+	}
+
 	write("quit");
 
 	mymsleep(100);
 
+	// after this, line_handler is no longer invoked
+	reactor->remove(r, this);
+
 	close(r);
 	close(w);
 
@@ -117,12 +239,12 @@ TextProgram::~TextProgram()
 
 		if (i == 0) {
 			dolog(debug, "Sending SIGTERM to process %d", pid);
-			kill(pid, SIGTERM);
+			::kill(pid, SIGTERM);
 			mymsleep(500);
 		}
 		else if (i == 1) {
 			dolog(debug, "Sending SIGKILL to process %d", pid);
-			kill(pid, SIGKILL);
+			::kill(pid, SIGKILL);
 			mymsleep(100);
 		}
 		else {
@@ -131,53 +253,120 @@ TextProgram::~TextProgram()
 	}
 }
 
-std::optional<std::string> TextProgram::read(std::optional<int> timeout_ms)
+std::optional<uint64_t> TextProgram::get_cpu_time_ns() const
 {
-	struct pollfd fds[] = { { r, POLLIN, 0 } };
+	if (pid == -1)
+		return { };
 
-	int use_to_ms = -1;
+	// nanosecond resolution
+	if (cpu_clock.has_value()) {
+		timespec ts { 0, 0 };
 
-	if (timeout_ms.has_value()) {
-		use_to_ms = timeout_ms.value();
-
-		dolog(debug, "%d] use time: %d", pid, use_to_ms);
+		if (clock_gettime(cpu_clock.value(), &ts) == 0)
+			return ts.tv_sec * 1000000000ull + ts.tv_nsec;
 	}
 
-	uint64_t start_ms = get_ts_ms();
+	// clock ticks (usually 10ms)
+	FILE *fh = fopen(myformat("/proc/%d/stat", pid).c_str(), "r");
+	if (!fh)
+		return { };
+
+	char buffer[4096] { 0 };
+	bool ok = fgets(buffer, sizeof buffer, fh) != nullptr;
+	fclose(fh);
+
+	// the program name (2nd field) can contain spaces
+	char *p = ok ? strrchr(buffer, ')') : nullptr;
+	if (!p)
+		return { };
+
+	unsigned long long utime = 0;
+	unsigned long long stime = 0;
+
+	// state is field 3, utime and stime are fields 14 and 15
+	if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+		return { };
 
-	std::string buffer;
+	return (utime + stime) * 1000000000ull / sysconf(_SC_CLK_TCK);
+}
+
+void TextProgram::kill()
+{
+	if (pid == -1)
+		return;
+
+	// it runs in its own session, see exec_with_pipe
+	if (::kill(-pid, SIGKILL) == -1)
+		::kill(pid, SIGKILL);
+}
 
+bool TextProgram::readable()
+{
 	for(;;) {
-		int64_t time_left = use_to_ms == -1 ? 86400000 : (start_ms + use_to_ms - get_ts_ms());
-		if (timeout_ms.has_value())
-			dolog(debug, "time left: %ld", time_left);
-		if (time_left < 0)
-			break;
+		if (buffer_end == buffer.size()) {
+			// a program that writes without newlines would use all memory
+			if (buffer.size() >= max_line_length) {
+				dolog(warning, "Process %d sent a line of more than %zu bytes, considering it failed", pid, max_line_length);
 
-		int rc = poll(fds, 1, time_left);
-		if (rc == 1) {
-			char temp[2] { 0 };
+				line_handler({ });
 
-			int rc = ::read(r, temp, 1);
-			if (rc == 0)
-				break;
-			if (rc == -1) {
-				dolog(debug, "read error: %s", strerror(errno));
-				break;
+				return false;
 			}
 
-			if (temp[0] == '\r') {
-				// ignore
-			}
-			else if (temp[0] == '\n') {
-				return buffer;
-			}
+			buffer.resize(std::min(buffer.size() * 2, max_line_length));
+		}
+
+		size_t  space = buffer.size() - buffer_end;
+		ssize_t n     = ::read(r, buffer.data() + buffer_end, space);
+
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
 
-			buffer += temp;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
+
+			dolog(debug, "read error: %s", strerror(errno));
 		}
-	}
 
-	return { };
+		if (n <= 0) {
+			line_handler({ });
+
+			return false;
+		}
+
+		buffer_end += n;
+
+		// hand out all complete lines, they point into the buffer
+		size_t start = 0;
+
+		for(;;) {
+			char *begin = buffer.data() + start;
+			char *lf    = reinterpret_cast<char *>(memchr(begin, '\n', buffer_end - start));
+
+			if (!lf)
+				break;
+
+			size_t len = lf - begin;
+
+			start += len + 1;
+
+			if (len > 0 && begin[len - 1] == '\r')
+				len--;
+
+			line_handler(std::string_view(begin, len));
+		}
+
+		// keep the start of an incomplete line for the next time
+		if (start > 0) {
+			memmove(buffer.data(), buffer.data() + start, buffer_end - start);
+
+			buffer_end -= start;
+		}
+
+		if (size_t(n) < space)
+			return true;
+	}
 }
 
 bool TextProgram::write(const std::string & text)
@@ -2,23 +2,57 @@
 // Released under MIT license
 
 #pragma once
+#include <functional>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
 #include <sys/types.h>
 
-class TextProgram
+#include "reactor.h"
+
+void log_spawn_statistics();
+
+class TextProgram : public ReactorClient
 {
 private:
 	pid_t pid;
 	int r, w;
 
+	// cpu-time clock of the process, if the kernel gives us one
+	std::optional<clockid_t> cpu_clock;
+
+	Reactor *reactor { nullptr };
+
+	// invoked from the reactor thread for every line (without the newline,
+	// only valid during the call), without a value at end-of-file
+	const std::function<void(std::optional<std::string_view>)> line_handler;
+
+	// bytes [0, buffer_end) are the start of a line that is not complete yet
+	std::vector<char> buffer;
+	size_t            buffer_end { 0 };
+
+	// a longer line is an error (as if the program terminated)
+	static constexpr size_t max_line_length = 1024 * 1024;
+
 public:
-	TextProgram(const std::string & command, const std::string & dir);
+	TextProgram(const std::string & command, const std::string & dir, const std::function<void(std::optional<std::string_view>)> & line_handler);
 	~TextProgram();
 
 	pid_t getPid() const { return pid; }
 
-	std::optional<std::string> read(std::optional<int> timeout_ms);
+	// the one that reads from the program
+	Reactor *getReactor() const { return reactor; }
+
+	// user + system time of all threads of the process
+	std::optional<uint64_t> get_cpu_time_ns() const;
+
+	bool readable() override;
 
 	bool write(const std::string & text);
+
+	// for a hung program: it (and what it started) is stopped immediately
+	void kill();
 };
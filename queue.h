@@ -3,44 +3,240 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
-#include <queue>
+#include <optional>
+#include <stdint.h>
+#include <vector>
 
+
+// bounded multi-producer/multi-consumer queue. try_push() and try_pop() are
+// lock-free (a ring of cells with sequence numbers, D. Vyukov); the mutex is
+// only used to put threads to sleep when the queue is full or empty.
+// After close(), push() fails and pop() returns nothing once the queue is empty.
 template <class T>
 class Queue
 {
 private:
+	typedef struct {
+		std::atomic_size_t seq;
+		T                  data;
+	} cell_t;
+
+	std::vector<cell_t> cells;
+	const size_t        mask;
+
+	alignas(64) std::atomic_size_t head { 0 };  // next push
+	alignas(64) std::atomic_size_t tail { 0 };  // next pop
+
+	std::atomic_bool closed { false };
+
+	std::mutex              m;
 	std::condition_variable cv;
-	mutable std::mutex m;
-	std::queue<T> q;
+	std::atomic_int         n_waiting { 0 };
+
+	std::atomic_size_t n_pushed  { 0 };
+	std::atomic_size_t max_depth { 0 };
+
+	static size_t round_up(const size_t n)
+	{
+		size_t out = 1;
+
+		while(out < n)
+			out <<= 1;
+
+		return out;
+	}
+
+	void wake()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (n_waiting.load() > 0) {
+			std::lock_guard<std::mutex> lock(m);
+			cv.notify_all();
+		}
+	}
+
+	// waits until 'ready' returns true, the queue was closed or 'deadline' passed
+	template <class F>
+	bool wait(F ready, const std::optional<std::chrono::steady_clock::time_point> & deadline)
+	{
+		std::unique_lock<std::mutex> lock(m);
+
+		n_waiting++;
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		bool rc = true;
+
+		while(!ready() && !closed) {
+			if (deadline.has_value() == false)
+				cv.wait(lock);
+			else if (cv.wait_until(lock, deadline.value()) == std::cv_status::timeout) {
+				rc = ready();
+				break;
+			}
+		}
+
+		n_waiting--;
+
+		return rc;
+	}
 
 public:
-	Queue(void)
+	Queue(const size_t capacity = 1024) : cells(round_up(capacity)), mask(round_up(capacity) - 1)
 	{
+		for(size_t i=0; i<cells.size(); i++)
+			cells[i].seq.store(i, std::memory_order_relaxed);
 	}
 
 	~Queue(void)
 	{
 	}
 
-	void push(T t)
+	// false when the queue is full or closed
+	bool try_push(const T & t)
 	{
+		if (closed)
+			return false;
+
+		size_t pos = head.load(std::memory_order_relaxed);
+
+		for(;;) {
+			cell_t & c   = cells[pos & mask];
+			size_t   seq = c.seq.load(std::memory_order_acquire);
+			intptr_t dif = intptr_t(seq) - intptr_t(pos);
+
+			if (dif == 0) {
+				if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					c.data = t;
+					c.seq.store(pos + 1, std::memory_order_release);
+					break;
+				}
+			}
+			else if (dif < 0) {
+				return false;
+			}
+			else {
+				pos = head.load(std::memory_order_relaxed);
+			}
+		}
+
+		n_pushed++;
+
+		size_t d = depth();
+		size_t cur = max_depth;
+		while(d > cur && !max_depth.compare_exchange_weak(cur, d)) {
+		}
+
+		wake();
+
+		return true;
+	}
+
+	// blocks while the queue is full; false when it was closed
+	bool push(const T & t)
+	{
+		while(!try_push(t)) {
+			if (closed)
+				return false;
+
+			wait([this] { return depth() <= mask; }, { });
+		}
+
+		return true;
+	}
+
+	std::optional<T> try_pop(void)
+	{
+		size_t pos = tail.load(std::memory_order_relaxed);
+
+		for(;;) {
+			cell_t & c   = cells[pos & mask];
+			size_t   seq = c.seq.load(std::memory_order_acquire);
+			intptr_t dif = intptr_t(seq) - intptr_t(pos + 1);
+
+			if (dif == 0) {
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					T val = c.data;
+					c.seq.store(pos + mask + 1, std::memory_order_release);
+
+					wake();
+
+					return val;
+				}
+			}
+			else if (dif < 0) {
+				return { };
+			}
+			else {
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// blocks while the queue is empty; nothing when it is empty and closed
+	std::optional<T> pop(void)
+	{
+		for(;;) {
+			auto val = try_pop();
+
+			if (val.has_value() || (closed && depth() == 0))
+				return val;
+
+			wait([this] { return depth() > 0; }, { });
+		}
+	}
+
+	// nothing when no element arrived within 'timeout_ms' or when closed
+	std::optional<T> pop(const int timeout_ms)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+		for(;;) {
+			auto val = try_pop();
+
+			if (val.has_value() || (closed && depth() == 0))
+				return val;
+
+			if (wait([this] { return depth() > 0; }, deadline) == false)
+				return { };
+		}
+	}
+
+	// wakes all threads that wait in push() or pop()
+	void close(void)
+	{
+		closed = true;
+
 		std::lock_guard<std::mutex> lock(m);
-		q.push(t);
-		cv.notify_one();
+		cv.notify_all();
 	}
 
-	T pop(void)
+	bool is_closed(void) const
 	{
-		std::unique_lock<std::mutex> lock(m);
+		return closed;
+	}
+
+	// number of elements (approximately, while other threads use the queue)
+	size_t depth(void) const
+	{
+		size_t h = head.load();
+		size_t t = tail.load();
 
-		while(q.empty())
-			cv.wait(lock);
+		return h > t ? h - t : 0;
+	}
 
-		T val = q.front();
-		q.pop();
+	size_t get_n_pushed(void) const
+	{
+		return n_pushed;
+	}
 
-		return val;
+	size_t get_max_depth(void) const
+	{
+		return max_depth;
 	}
 };
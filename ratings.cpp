@@ -0,0 +1,565 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <algorithm>
+#include <cmath>
+#include <inttypes.h>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.h"
+#include "log.h"
+#include "ratings.h"
+#include "str.h"
+#include "time.h"
+
+
+// the parameters are in natural units: elo * ln(10) / 400
+static const double elo_scale = 400. / log(10.);
+
+// rows of the result matrix per thread, below this it is not worth it
+static const int rows_per_thread = 16;
+
+static double sigmoid(const double z)
+{
+	return 1. / (1. + exp(-z));
+}
+
+// Gauss-Jordan with partial pivoting; false when 'a' (m * m) is singular
+static bool invert(std::vector<double> *const a, const int m)
+{
+	std::vector<double> inv(m * m, 0.);
+
+	for(int i=0; i<m; i++)
+		inv[i * m + i] = 1.;
+
+	for(int col=0; col<m; col++) {
+		int pivot = col;
+
+		for(int row=col + 1; row<m; row++) {
+			if (fabs((*a)[row * m + col]) > fabs((*a)[pivot * m + col]))
+				pivot = row;
+		}
+
+		if (fabs((*a)[pivot * m + col]) < 1e-12)
+			return false;
+
+		if (pivot != col) {
+			for(int i=0; i<m; i++) {
+				std::swap((*a)[pivot * m + i], (*a)[col * m + i]);
+				std::swap(inv[pivot * m + i], inv[col * m + i]);
+			}
+		}
+
+		double div = (*a)[col * m + col];
+
+		for(int i=0; i<m; i++) {
+			(*a)[col * m + i] /= div;
+			inv[col * m + i]  /= div;
+		}
+
+		for(int row=0; row<m; row++) {
+			double f = (*a)[row * m + col];
+
+			if (row == col || f == 0.)
+				continue;
+
+			for(int i=0; i<m; i++) {
+				(*a)[row * m + i] -= f * (*a)[col * m + i];
+				inv[row * m + i]  -= f * inv[col * m + i];
+			}
+		}
+	}
+
+	*a = inv;
+
+	return true;
+}
+
+Ratings::Ratings(const std::vector<engine_parameters_t *> & engines, const double prior, const int n_threads, const int interval_ms) :
+	engines(engines),
+	prior(prior),
+	n_threads(std::max(1, n_threads)),
+	interval_ms(interval_ms)
+{
+	cells.resize(engines.size() * engines.size(), { 0., 0., 0. });
+
+	last_poll = get_ts_ms();
+}
+
+int Ratings::index_of(const engine_parameters_t *const p) const
+{
+	for(size_t i=0; i<engines.size(); i++) {
+		if (engines.at(i) == p)
+			return i;
+	}
+
+	return -1;
+}
+
+void Ratings::add(const engine_parameters_t *const black, const engine_parameters_t *const white, const std::string & result)
+{
+	int b = index_of(black);
+	int w = index_of(white);
+
+	if (b == -1 || w == -1 || b == w || result.empty() || result.at(0) == '?')
+		return;
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	cell_t & c = cells.at(b * engines.size() + w);
+
+	if (result.at(0) == 'b' || result.at(0) == 'B')
+		c.black_wins++;
+	else if (result.at(0) == 'w' || result.at(0) == 'W')
+		c.white_wins++;
+	else
+		c.draws++;
+
+	n_games++;
+}
+
+// log-likelihood of the games in 'counts' for the parameters 'p', with its
+// gradient 'g' and hessian 'h' (m * m). 'index': engine -> parameter (-1 for
+// engines without games), p[m - 1] is the draw margin when 'with_draws', the
+// one before that the advantage of white.
+double Ratings::evaluate(const std::vector<cell_t> & counts, const std::vector<int> & index, const int m, const bool with_draws, const std::vector<double> & p, std::vector<double> *const g, std::vector<double> *const h) const
+{
+	const int n          = engines.size();
+	const int i_white    = m - (with_draws ? 2 : 1);
+	const int i_draw     = with_draws ? m - 1 : -1;
+	const double delta   = with_draws ? p[i_draw] : 0.;
+
+	auto rows = [&](const int from, const int to, double *const ll, std::vector<double> *const g, std::vector<double> *const h) {
+		for(int b=from; b<to; b++) {
+			if (index[b] == -1)
+				continue;
+
+			for(int w=0; w<n; w++) {
+				const cell_t & c = counts[b * n + w];
+
+				if (c.black_wins + c.white_wins + c.draws == 0.)
+					continue;
+
+				const int ib = index[b];
+				const int iw = index[w];
+
+				// white wins with probability sigmoid(u), black with sigmoid(v)
+				double u  = p[iw] + p[i_white] - p[ib] - delta;
+				double v  = p[ib] - p[iw] - p[i_white] - delta;
+				double su = sigmoid(u);
+				double sv = sigmoid(v);
+				double du = su * (1. - su);
+				double dv = sv * (1. - sv);
+
+				*ll += c.white_wins * log(su) + c.black_wins * log(sv);
+
+				double gu  = c.white_wins * (1. - su);
+				double gv  = c.black_wins * (1. - sv);
+				double huu = -c.white_wins * du;
+				double hvv = -c.black_wins * dv;
+				double huv = 0.;
+
+				if (c.draws > 0.) {
+					double d   = std::max(1. - su - sv, 1e-300);
+					double ddu = du * (1. - 2. * su);
+					double ddv = dv * (1. - 2. * sv);
+
+					*ll += c.draws * log(d);
+
+					gu  -= c.draws * du / d;
+					gv  -= c.draws * dv / d;
+					huu -= c.draws * (ddu / d + du * du / (d * d));
+					hvv -= c.draws * (ddv / d + dv * dv / (d * d));
+					huv -= c.draws * du * dv / (d * d);
+				}
+
+				// derivatives of u and v to the parameters involved
+				const int    idx[] { iw, i_white, ib, i_draw };
+				const double ju[]  { 1., 1., -1., -1. };
+				const double jv[]  { -1., -1., 1., -1. };
+				const int    n_idx = with_draws ? 4 : 3;
+
+				for(int k=0; k<n_idx; k++) {
+					(*g)[idx[k]] += gu * ju[k] + gv * jv[k];
+
+					for(int l=0; l<n_idx; l++)
+						(*h)[idx[k] * m + idx[l]] += huu * ju[k] * ju[l] + huv * (ju[k] * jv[l] + jv[k] * ju[l]) + hvv * jv[k] * jv[l];
+				}
+			}
+		}
+	};
+
+	g->assign(m, 0.);
+	h->assign(m * m, 0.);
+
+	double ll = 0.;
+
+	int n_parts = std::min(n_threads, n / rows_per_thread);
+
+	if (n_parts < 2) {
+		rows(0, n, &ll, g, h);
+
+		return ll;
+	}
+
+	std::vector<double>               part_ll(n_parts, 0.);
+	std::vector<std::vector<double> > part_g(n_parts, std::vector<double>(m, 0.));
+	std::vector<std::vector<double> > part_h(n_parts, std::vector<double>(m * m, 0.));
+	std::vector<std::thread *>        threads;
+
+	for(int t=0; t<n_parts; t++)
+		threads.push_back(new std::thread(rows, n * t / n_parts, n * (t + 1) / n_parts, &part_ll[t], &part_g[t], &part_h[t]));
+
+	for(int t=0; t<n_parts; t++) {
+		threads.at(t)->join();
+
+		delete threads.at(t);
+
+		ll += part_ll[t];
+
+		for(int i=0; i<m; i++)
+			(*g)[i] += part_g[t][i];
+
+		for(int i=0; i<m * m; i++)
+			(*h)[i] += part_h[t][i];
+	}
+
+	return ll;
+}
+
+std::optional<Ratings::solution_t> Ratings::solve(const std::vector<cell_t> & counts_in, const uint64_t n_games_in)
+{
+	const int n = engines.size();
+
+	solution_t s { };
+	s.games.resize(n, 0);
+	s.points.resize(n, 0.);
+	s.draws.resize(n, 0);
+	s.n_games = n_games_in;
+
+	std::vector<int> index(n, -1);
+	bool with_draws = false;
+
+	for(int b=0; b<n; b++) {
+		for(int w=0; w<n; w++) {
+			const cell_t & c = counts_in[b * n + w];
+			int games = c.black_wins + c.white_wins + c.draws;
+
+			if (games == 0)
+				continue;
+
+			index[b] = index[w] = 0;
+
+			s.games[b]  += games;
+			s.games[w]  += games;
+			s.points[b] += c.black_wins + c.draws / 2.;
+			s.points[w] += c.white_wins + c.draws / 2.;
+			s.draws[b]  += c.draws;
+			s.draws[w]  += c.draws;
+
+			with_draws |= c.draws > 0.;
+		}
+	}
+
+	int k = 0;
+
+	for(int i=0; i<n; i++) {
+		if (index[i] != -1)
+			index[i] = k++;
+	}
+
+	if (k < 2)
+		return { };
+
+	// the prior: virtual games between each pair of engines that met, half
+	// of them won by each, with both colours
+	std::vector<cell_t> counts = counts_in;
+
+	for(int i=0; i<n; i++) {
+		for(int j=i + 1; j<n; j++) {
+			const cell_t & a = counts_in[i * n + j];
+			const cell_t & b = counts_in[j * n + i];
+
+			if (a.black_wins + a.white_wins + a.draws + b.black_wins + b.white_wins + b.draws == 0.)
+				continue;
+
+			counts[i * n + j].black_wins += prior / 4.;
+			counts[i * n + j].white_wins += prior / 4.;
+			counts[j * n + i].black_wins += prior / 4.;
+			counts[j * n + i].white_wins += prior / 4.;
+		}
+	}
+
+	const int m = k + 1 + with_draws;
+
+	// the previous solution is a good start when only a few games were added
+	std::vector<double> p(m, 0.);
+
+	if (warm_start.size() == size_t(m))
+		p = warm_start;
+	else if (with_draws)
+		p[m - 1] = 0.5;
+
+	std::vector<double> g, h;
+	double ll = evaluate(counts, index, m, with_draws, p, &g, &h);
+
+	// -h with the ratings all shifting by the same amount (which does not
+	// change the likelihood) made non-singular
+	auto fixed = [k, m](const std::vector<double> & h) {
+		std::vector<double> a(m * m);
+
+		for(int i=0; i<m * m; i++)
+			a[i] = -h[i];
+
+		for(int i=0; i<k; i++) {
+			for(int j=0; j<k; j++)
+				a[i * m + j] += 1.;
+		}
+
+		return a;
+	};
+
+	// Newton iterations (instead of minorization-maximization which needs
+	// many more of them); the step is halved until the likelihood improves
+	bool converged = false;
+
+	for(int it=0; it<100 && !converged; it++) {
+		std::vector<double> a = fixed(h);
+
+		if (invert(&a, m) == false)
+			return { };
+
+		std::vector<double> step(m, 0.);
+
+		for(int i=0; i<m; i++) {
+			for(int j=0; j<m; j++)
+				step[i] += a[i * m + j] * g[j];
+		}
+
+		for(double t=1.;; t /= 2.) {
+			std::vector<double> q(p);
+
+			for(int i=0; i<m; i++)
+				q[i] += t * step[i];
+
+			if (with_draws)
+				q[m - 1] = std::max(q[m - 1], 1e-6);
+
+			std::vector<double> g2, h2;
+			double ll2 = evaluate(counts, index, m, with_draws, q, &g2, &h2);
+
+			if (ll2 >= ll - 1e-9 || t < 1e-6) {
+				double max_step = 0.;
+
+				for(int i=0; i<m; i++)
+					max_step = std::max(max_step, fabs(q[i] - p[i]));
+
+				converged = max_step < 1e-9 || t < 1e-6;
+
+				p  = q;
+				g  = g2;
+				h  = h2;
+				ll = ll2;
+
+				break;
+			}
+		}
+	}
+
+	warm_start = p;
+
+	// the covariance is the inverse of -h, minus what fixed() added
+	std::vector<double> cov = fixed(h);
+
+	if (invert(&cov, m) == false)
+		return { };
+
+	double mean = 0.;
+
+	for(int i=0; i<k; i++)
+		mean += p[i];
+
+	mean /= k;
+
+	s.elo.resize(n, NAN);
+	s.cov.resize(n * n, NAN);
+
+	for(int i=0; i<n; i++) {
+		if (index[i] == -1)
+			continue;
+
+		s.elo[i] = (p[index[i]] - mean) * elo_scale;
+
+		for(int j=0; j<n; j++) {
+			if (index[j] != -1)
+				s.cov[i * n + j] = (cov[index[i] * m + index[j]] - 1. / (k * k)) * elo_scale * elo_scale;
+		}
+	}
+
+	s.white_advantage    = p[k] * elo_scale;
+	s.white_advantage_sd = sqrt(std::max(0., cov[k * m + k])) * elo_scale;
+	s.draw_elo           = with_draws ? p[m - 1] * elo_scale : 0.;
+
+	return s;
+}
+
+bool Ratings::update()
+{
+	std::unique_lock<std::mutex> slck(solve_lock);
+
+	std::vector<cell_t> counts;
+	uint64_t            n_games_now = 0;
+
+	{
+		std::unique_lock<std::mutex> lck(lock);
+
+		counts      = cells;
+		n_games_now = n_games;
+	}
+
+	if (solution.has_value() && solution.value().n_games == n_games_now)
+		return true;
+
+	uint64_t start_ts = get_ts_ms();
+
+	auto rc = solve(counts, n_games_now);
+
+	if (rc.has_value() == false)
+		return false;
+
+	solution = rc;
+
+	std::vector<elo_rating_t> out;
+
+	const solution_t & s = solution.value();
+	const size_t       n = engines.size();
+
+	for(size_t i=0; i<n; i++) {
+		if (std::isnan(s.elo[i]) == false)
+			out.push_back({ engines.at(i), s.elo[i], 1.96 * sqrt(std::max(0., s.cov[i * n + i])) });
+	}
+
+	{
+		std::unique_lock<std::mutex> plck(published_lock);
+
+		published = std::move(out);
+	}
+
+	dolog(debug, "Ratings of %" PRIu64 " games took %" PRIu64 "ms", n_games_now, get_ts_ms() - start_ts);
+
+	return true;
+}
+
+void Ratings::poll(const bool request)
+{
+	uint64_t now = get_ts_ms();
+
+	// for get_ratings() (the metrics), also when nothing is logged
+	if (now - last_update >= 1000) {
+		update();
+
+		last_update = now;
+	}
+
+	if (request == false && (interval_ms <= 0 || now - last_poll < uint64_t(interval_ms)))
+		return;
+
+	last_poll = now;
+
+	if (update() == false) {
+		if (request)
+			dolog(info, "Not enough games for ratings yet");
+
+		return;
+	}
+
+	if (request == false && solution.value().n_games == last_logged)
+		return;
+
+	last_logged = solution.value().n_games;
+
+	log_table(request);
+}
+
+std::vector<elo_rating_t> Ratings::get_ratings()
+{
+	std::unique_lock<std::mutex> plck(published_lock);
+
+	return published;
+}
+
+void Ratings::log_table(const bool los)
+{
+	std::unique_lock<std::mutex> slck(solve_lock);
+
+	if (solution.has_value() == false) {
+		dolog(info, "No ratings: not enough games");
+
+		return;
+	}
+
+	const solution_t & s = solution.value();
+	const int          n = engines.size();
+
+	std::vector<int> order;
+	size_t name_width = 4;
+
+	for(int i=0; i<n; i++) {
+		if (std::isnan(s.elo[i]) == false) {
+			order.push_back(i);
+
+			name_width = std::max(name_width, engines.at(i)->name.size());
+		}
+	}
+
+	std::sort(order.begin(), order.end(), [&s](const int a, const int b) { return s.elo[a] > s.elo[b]; });
+
+	dolog(info, "Ratings after %" PRIu64 " games (maximum likelihood, 95%% confidence):", s.n_games);
+	dolog(info, "%4s %-*s %7s %6s %6s %6s %6s", "rank", int(name_width), "name", "elo", "+/-", "games", "score", "draws");
+
+	int rank = 1;
+
+	for(int i : order) {
+		dolog(info, "%4d %-*s %7.1f %6.1f %6d %5.1f%% %5.1f%%", rank++, int(name_width), engines.at(i)->name.c_str(), s.elo[i], 1.96 * sqrt(std::max(0., s.cov[i * n + i])), s.games[i], s.points[i] * 100. / s.games[i], s.draws[i] * 100. / s.games[i]);
+	}
+
+	dolog(info, "White advantage: %.1f +/- %.1f elo, draw elo: %.1f", s.white_advantage, 1.96 * s.white_advantage_sd, s.draw_elo);
+
+	if (los == false)
+		return;
+
+	// likelihood of superiority (%) of the engine of the row over that of the column
+	std::string header = myformat("%4s %-*s", "los", int(name_width), "");
+
+	for(size_t c=0; c<order.size(); c++)
+		header += myformat(" %4zu", c + 1);
+
+	dolog(info, "%s", header.c_str());
+
+	for(size_t r=0; r<order.size(); r++) {
+		int i = order.at(r);
+
+		std::string line = myformat("%4zu %-*s", r + 1, int(name_width), engines.at(i)->name.c_str());
+
+		for(size_t c=0; c<order.size(); c++) {
+			int j = order.at(c);
+
+			if (i == j) {
+				line += "     ";
+
+				continue;
+			}
+
+			double var = s.cov[i * n + i] + s.cov[j * n + j] - 2. * s.cov[i * n + j];
+			double p   = 0.5 * erfc(-(s.elo[i] - s.elo[j]) / sqrt(2. * std::max(var, 1e-12)));
+
+			line += myformat(" %4d", int(p * 100. + 0.5));
+		}
+
+		dolog(info, "%s", line.c_str());
+	}
+}
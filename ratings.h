@@ -0,0 +1,87 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+
+
+typedef struct {
+	const engine_parameters_t *engine;
+	double elo, error;  // error: 95% confidence
+} elo_rating_t;
+
+// maximum likelihood elo ratings of all games played so far (independent of
+// the order in which they finished). Bradley-Terry with an advantage for
+// white and a draw margin (Rao-Kupper), as in BayesElo.
+class Ratings
+{
+private:
+	typedef struct {
+		double black_wins, white_wins, draws;
+	} cell_t;
+
+	typedef struct {
+		std::vector<double> elo;  // per engine, mean 0
+		std::vector<double> cov;  // of the elo ratings, n * n
+		double white_advantage, white_advantage_sd;  // in elo
+		double draw_elo;
+		std::vector<int> games;   // per engine
+		std::vector<double> points;
+		std::vector<int> draws;
+		uint64_t n_games;
+	} solution_t;
+
+	const std::vector<engine_parameters_t *> engines;
+	const double prior;     // virtual games per pair of engines that met
+	const int    n_threads;
+	const int    interval_ms;
+
+	std::mutex lock;
+	std::vector<cell_t> cells;  // [black * n + white]
+	uint64_t n_games { 0 };
+
+	std::mutex solve_lock;      // one solve at a time
+	std::optional<solution_t> solution;
+	std::vector<double> warm_start;  // parameters of the previous solve
+
+	// what get_ratings() returns, it does not wait for a solve
+	std::mutex                published_lock;
+	std::vector<elo_rating_t> published;
+
+	uint64_t last_poll { 0 };
+	uint64_t last_update { 0 };  // by poll()
+	uint64_t last_logged { 0 };  // n_games
+
+	int index_of(const engine_parameters_t *const p) const;
+	double evaluate(const std::vector<cell_t> & counts, const std::vector<int> & index, const int m, const bool with_draws, const std::vector<double> & p, std::vector<double> *const g, std::vector<double> *const h) const;
+	std::optional<solution_t> solve(const std::vector<cell_t> & counts, const uint64_t n_games_in);
+
+public:
+	// 'interval_ms': how often poll() logs the ratings, 0 for never
+	Ratings(const std::vector<engine_parameters_t *> & engines, const double prior, const int n_threads, const int interval_ms);
+
+	// 'result' as in play(), results starting with '?' are ignored
+	void add(const engine_parameters_t *const black, const engine_parameters_t *const white, const std::string & result);
+
+	// re-computes the ratings when games were added since the previous
+	// call; false if they cannot be computed (yet)
+	bool update();
+
+	// called regularly while the tournament runs, updates the ratings at
+	// most once per second; 'request': log the ratings now (e.g. SIGUSR1)
+	void poll(const bool request);
+
+	// of the last update(), without the engines that did not play yet. Does
+	// not wait for an update that is in progress (for other threads).
+	std::vector<elo_rating_t> get_ratings();
+
+	// 'los': also the likelihood-of-superiority table
+	void log_table(const bool los);
+};
@@ -0,0 +1,217 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <atomic>
+#include <errno.h>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "error.h"
+#include "log.h"
+#include "reactor.h"
+#include "time.h"
+
+
+static std::vector<Reactor *> reactors;
+static std::atomic_uint       reactor_nr { 0 };
+
+Reactor::Reactor()
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1)
+		error_exit(true, "epoll_create1 failed");
+
+	wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (wakeup_fd == -1)
+		error_exit(true, "eventfd failed");
+
+	struct epoll_event ev { };
+	ev.events  = EPOLLIN;
+	ev.data.fd = wakeup_fd;
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &ev) == -1)
+		error_exit(true, "epoll_ctl failed");
+
+	th = new std::thread(&Reactor::run, this);
+}
+
+Reactor::~Reactor()
+{
+	stop = true;
+
+	wakeup();
+
+	th->join();
+	delete th;
+
+	close(wakeup_fd);
+	close(epoll_fd);
+}
+
+void Reactor::add(const int fd, ReactorClient *const c)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	clients[fd] = c;
+
+	struct epoll_event ev { };
+	ev.events  = EPOLLIN;
+	ev.data.fd = fd;
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+		error_exit(true, "epoll_ctl failed for fd %d", fd);
+}
+
+void Reactor::remove(const int fd, ReactorClient *const c)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	auto it = clients.find(fd);
+
+	// may have been removed already after an end-of-file, fd can then be in use by an other client
+	if (it != clients.end() && it->second == c) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+
+		clients.erase(it);
+	}
+}
+
+void Reactor::wakeup()
+{
+	uint64_t v = 1;
+	if (write(wakeup_fd, &v, sizeof v) != sizeof v)
+		dolog(warning, "Cannot wake up reactor thread");
+}
+
+void Reactor::add_timer(const uint64_t at_ns, const void *const owner, const std::function<void()> & cb)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	bool first = timers.empty() || at_ns < timers.begin()->first;
+
+	timers.insert({ at_ns, { owner, cb } });
+
+	lck.unlock();
+
+	// epoll_wait() has to be restarted with a shorter timeout
+	if (first)
+		wakeup();
+}
+
+void Reactor::remove_timers(const void *const owner)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	for(auto it = timers.begin(); it != timers.end();) {
+		if (it->second.owner == owner)
+			it = timers.erase(it);
+		else
+			it++;
+	}
+}
+
+// with the lock held
+void Reactor::fire_timers()
+{
+	uint64_t now = get_ts_ns();
+
+	while(timers.empty() == false && timers.begin()->first <= now) {
+		auto cb = std::move(timers.begin()->second.cb);
+
+		timers.erase(timers.begin());
+
+		cb();
+	}
+}
+
+size_t Reactor::get_n_clients()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	return clients.size();
+}
+
+void Reactor::run()
+{
+	constexpr int max_events = 64;
+
+	struct epoll_event events[max_events];
+
+	while(!stop) {
+		int timeout_ms = -1;
+
+		{
+			std::unique_lock<std::mutex> lck(lock);
+
+			if (timers.empty() == false) {
+				uint64_t now = get_ts_ns();
+				uint64_t at  = timers.begin()->first;
+
+				// rounded up: a timer does not fire early
+				timeout_ms = at <= now ? 0 : int((at - now + 999999) / 1000000);
+			}
+		}
+
+		int n = epoll_wait(epoll_fd, events, max_events, timeout_ms);
+
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+
+			error_exit(true, "epoll_wait failed");
+		}
+
+		std::unique_lock<std::mutex> lck(lock);
+
+		for(int i=0; i<n; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == wakeup_fd) {
+				uint64_t v = 0;
+				if (read(wakeup_fd, &v, sizeof v) != sizeof v)
+					dolog(debug, "Reading the wakeup counter of a reactor failed");
+
+				continue;
+			}
+
+			// may have been removed in the meantime (or even re-used)
+			auto it = clients.find(fd);
+			if (it == clients.end())
+				continue;
+
+			if (it->second->readable() == false) {
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+
+				clients.erase(it);
+			}
+		}
+
+		fire_timers();
+	}
+}
+
+void init_reactors(const int n)
+{
+	for(int i=0; i<n; i++)
+		reactors.push_back(new Reactor());
+
+	dolog(info, "%d reactor thread(s) started", n);
+}
+
+void stop_reactors()
+{
+	for(auto r : reactors)
+		delete r;
+
+	reactors.clear();
+}
+
+Reactor *get_reactor()
+{
+	return reactors.at(reactor_nr++ % reactors.size());
+}
@@ -0,0 +1,71 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <unordered_map>
+
+
+class ReactorClient
+{
+public:
+	virtual ~ReactorClient() { }
+
+	// invoked from the reactor thread when the file descriptor has data (or
+	// was closed), return false to stop watching it
+	virtual bool readable() = 0;
+};
+
+// one thread that waits (epoll) for data from the pipes of many engines, and
+// for the deadlines of the commands that were sent to them
+class Reactor
+{
+private:
+	int epoll_fd { -1 };
+	int wakeup_fd { -1 };
+
+	// held while dispatching: after remove() returns, the client is not called anymore
+	std::mutex                                   lock;
+	std::unordered_map<int, ReactorClient *>     clients;
+
+	typedef struct {
+		const void            *owner;
+		std::function<void()>  cb;
+	} reactor_timer_t;
+
+	std::multimap<uint64_t, reactor_timer_t>     timers;  // by get_ts_ns()
+
+	std::atomic_bool stop { false };
+	std::thread     *th   { nullptr };
+
+	void run();
+	void wakeup();
+	void fire_timers();
+
+public:
+	Reactor();
+	~Reactor();
+
+	void add(const int fd, ReactorClient *const c);
+	void remove(const int fd, ReactorClient *const c);
+
+	// 'cb' is invoked from the reactor thread at (or shortly after) 'at_ns'
+	// (get_ts_ns()), like readable(): it must not block. Not to be used from
+	// a callback of this reactor.
+	void add_timer(const uint64_t at_ns, const void *const owner, const std::function<void()> & cb);
+	// after this returns, no timer of 'owner' is invoked anymore
+	void remove_timers(const void *const owner);
+
+	size_t get_n_clients();
+};
+
+void     init_reactors(const int n);
+void     stop_reactors();
+// returns the reactors round-robin
+Reactor *get_reactor();
@@ -0,0 +1,47 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "log.h"
+#include "runner.h"
+
+
+TaskRunner::TaskRunner(const std::string & name, const int n_threads, const size_t capacity) : tasks(capacity)
+{
+	for(int i=0; i<n_threads; i++)
+		threads.push_back(new std::thread(&TaskRunner::run, this));
+
+	dolog(info, "%d %s thread(s) started", n_threads, name.c_str());
+}
+
+TaskRunner::~TaskRunner()
+{
+	tasks.close();
+
+	for(auto & th : threads) {
+		th->join();
+
+		delete th;
+	}
+}
+
+void TaskRunner::run()
+{
+	for(;;) {
+		auto task = tasks.pop();
+
+		if (task.has_value() == false)
+			break;
+
+		task.value()();
+	}
+}
+
+void TaskRunner::post(const std::function<void()> & task)
+{
+	if (tasks.push(task) == false)
+		dolog(error, "Task posted after the task runner stopped");
+}
@@ -0,0 +1,33 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "queue.h"
+
+
+// a few threads that execute what is posted to them, e.g. the next step of a
+// game once the reactor received the responses that it waited for
+class TaskRunner
+{
+private:
+	Queue<std::function<void()> > tasks;
+	std::vector<std::thread *>    threads;
+
+	void run();
+
+public:
+	// 'capacity' should be more than what can be posted at the same time:
+	// post() blocks when the queue is full
+	// 'name' is for the logging only
+	TaskRunner(const std::string & name, const int n_threads, const size_t capacity);
+	// executes what was posted before
+	~TaskRunner();
+
+	void post(const std::function<void()> & task);
+};
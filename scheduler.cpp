@@ -0,0 +1,395 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <stdlib.h>
+#include <vector>
+
+#include "engine.h"
+#include "log.h"
+#include "scheduler.h"
+
+
+Scheduler::Scheduler(const std::vector<engine_parameters_t *> & engines, const int iterations, const bool dynamic, const int min_games, const bool colour_balance) :
+	engines(engines),
+	dynamic(dynamic),
+	min_games(min_games),
+	colour_balance(colour_balance)
+{
+	size_t n = engines.size();
+
+	bool has_targets = false;
+
+	for(auto & engine : engines)
+		has_targets |= engine->target;
+
+	// gauntlet: only targets versus non-targets
+	for(size_t a=0; a<n; a++) {
+		for(size_t b=a + 1; b<n; b++) {
+			if (has_targets && engines[a]->target == engines[b]->target)
+				continue;
+
+			pairings.push_back({ a, b });
+		}
+	}
+
+	if (has_targets == false) {
+		dolog(info, "everybody against everybody");
+
+		for(int i=0; i<iterations; i++) {
+			for(size_t a=0; a<n; a++) {
+				for(size_t b=0; b<n; b++) {
+					if (a != b)
+						order.push_back({ engines[a], engines[b], int(order.size()) });
+				}
+			}
+		}
+	}
+	else {
+		dolog(info, "gauntlet(s)");
+
+		for(int i=0; i<iterations; i++) {
+			for(auto & target : engines) {
+				if (target->target == false)
+					continue;
+
+				for(size_t a=0; a<n; a++) {
+					if (engines[a]->target)
+						continue;
+
+					order.push_back({ target, engines[a], int(order.size()) });
+
+					order.push_back({ engines[a], target, int(order.size()) });
+				}
+			}
+		}
+	}
+
+	// the dynamic scheduler plays as many games, but distributes them differently
+	n_games = order.size();
+
+	if (dynamic) {
+		order.clear();
+
+		dolog(info, "Pairings are chosen on the expected information gain, at least %d games per pairing", min_games);
+	}
+
+	update_metrics();
+}
+
+// how much the (glicko-2) variances of both ratings are expected to
+// shrink by one game between them
+double Scheduler::information(const pairing_t & p)
+{
+	engine_parameters_t *a = engines.at(p.first);
+	engine_parameters_t *b = engines.at(p.second);
+
+	double mu_a = 0., phi_a = 0., mu_b = 0., phi_b = 0.;
+
+	{
+		std::unique_lock<std::mutex> lck(a->lock);
+		mu_a  = a->rating.Rating2();
+		phi_a = a->rating.Deviation2();
+	}
+
+	{
+		std::unique_lock<std::mutex> lck(b->lock);
+		mu_b  = b->rating.Rating2();
+		phi_b = b->rating.Deviation2();
+	}
+
+	auto g = [](const double phi) { return 1. / sqrt(1. + 3. * phi * phi / (M_PI * M_PI)); };
+
+	// 'v_inv' is the information of one game (1/v in the glicko-2 paper)
+	auto reduction = [](const double phi, const double v_inv) { double var = phi * phi; return var - 1. / (1. / var + v_inv); };
+
+	double e_a = 1. / (1. + exp(-g(phi_b) * (mu_a - mu_b)));
+	double e_b = 1. - e_a;
+
+	double out = reduction(phi_a, g(phi_b) * g(phi_b) * e_a * (1. - e_a)) + reduction(phi_b, g(phi_a) * g(phi_a) * e_b * (1. - e_b));
+
+	// the ratings do not know yet about the games in progress
+	return out / (1 + n_in_flight[p]);
+}
+
+// lock must be held
+const Scheduler::pairing_t *Scheduler::choose()
+{
+	const pairing_t *best = nullptr;
+
+	// pairings below the minimum first, fewest games first
+	for(auto & p : pairings) {
+		int played = n_played[p];
+
+		if (played < min_games && (best == nullptr || played < n_played[*best]))
+			best = &p;
+	}
+
+	if (best)
+		return best;
+
+	double best_value = -1.;
+
+	for(auto & p : pairings) {
+		double value = information(p);
+
+		if (best == nullptr || value > best_value) {
+			best       = &p;
+			best_value = value;
+		}
+	}
+
+	return best;
+}
+
+work_t Scheduler::to_work(const pairing_t & p, const bool first_is_black, const int nr) const
+{
+	engine_parameters_t *first  = engines.at(p.first);
+	engine_parameters_t *second = engines.at(p.second);
+
+	if (first_is_black)
+		return { first, second, nr };
+
+	return { second, first, nr };
+}
+
+std::optional<work_t> Scheduler::next(std::atomic_bool *const stop_flag)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	for(;;) {
+		if (*stop_flag)
+			return { };
+
+		auto w = take();
+
+		if (w.has_value())
+			return w;
+
+		if (all_scheduled() && retry.empty() && n_busy == 0)
+			return { };
+
+		// a game in progress may be requeued; stop_flag is set without
+		// notifying (e.g. from the signal handler), hence the timeout
+		cv.wait_for(lck, std::chrono::milliseconds(250));
+	}
+}
+
+std::optional<work_t> Scheduler::try_next()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	return take();
+}
+
+// lock must be held
+std::optional<work_t> Scheduler::take()
+{
+	if (retry.empty() == false) {
+		work_t w = retry.back();
+		retry.pop_back();
+
+		if (dynamic)
+			n_in_flight[pairing_of(w)]++;
+
+		n_busy++;
+
+		update_metrics();
+
+		return w;
+	}
+
+	if (all_scheduled())
+		return { };
+
+	n_busy++;
+
+	if (dynamic == false) {
+		work_t w = order.at(next_nr++);
+
+		update_metrics();
+
+		return w;
+	}
+
+	n_scheduled++;
+
+	const pairing_t *p = choose();
+
+	bool first_is_black = rand() & 1;
+
+	if (colour_balance)
+		first_is_black = n_black_first[*p] * 2 <= n_played[*p];
+
+	n_played[*p]++;
+	n_in_flight[*p]++;
+
+	if (first_is_black)
+		n_black_first[*p]++;
+
+	work_t w = to_work(*p, first_is_black, next_nr++);
+
+	dolog(debug, "Scheduled %s versus %s (%d games in this pairing)", w.p1->name.c_str(), w.p2->name.c_str(), n_played[*p]);
+
+	update_metrics();
+
+	return w;
+}
+
+std::vector<work_t> Scheduler::peek(const int n)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	std::vector<work_t> out;
+
+	for(auto it = retry.rbegin(); it != retry.rend() && int(out.size()) < n; it++)
+		out.push_back(*it);
+
+	if (all_scheduled())
+		return out;
+
+	if (dynamic == false) {
+		for(int nr=next_nr; nr<n_games && int(out.size()) < n; nr++) {
+			if (restored.find(nr) == restored.end())
+				out.push_back(order.at(nr));
+		}
+
+		return out;
+	}
+
+	// choose() as if the earlier ones were handed out; undone afterwards
+	std::vector<pairing_t> chosen;
+
+	for(int i=n_scheduled; i<n_games && int(out.size()) < n; i++) {
+		const pairing_t *p = choose();
+
+		chosen.push_back(*p);
+
+		n_played[*p]++;
+		n_in_flight[*p]++;
+
+		// the colours do not matter for pre-warming
+		out.push_back(to_work(*p, true, next_nr + int(chosen.size()) - 1));
+	}
+
+	for(auto & p : chosen) {
+		n_played[p]--;
+		n_in_flight[p]--;
+	}
+
+	return out;
+}
+
+Scheduler::pairing_t Scheduler::pairing_of(const work_t & w) const
+{
+	for(auto & p : pairings) {
+		if ((engines.at(p.first) == w.p1 && engines.at(p.second) == w.p2) || (engines.at(p.first) == w.p2 && engines.at(p.second) == w.p1))
+			return p;
+	}
+
+	return { 0, 0 };
+}
+
+void Scheduler::done(const work_t & w)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	n_busy--;
+
+	if (dynamic)
+		n_in_flight[pairing_of(w)]--;
+
+	update_metrics();
+
+	cv.notify_all();
+}
+
+void Scheduler::requeue(const work_t & w)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	n_busy--;
+
+	if (dynamic)
+		n_in_flight[pairing_of(w)]--;
+
+	retry.push_back(w);
+
+	update_metrics();
+
+	cv.notify_all();
+
+	dolog(info, "Game %d (%s versus %s) will be played again", w.nr, w.p1->name.c_str(), w.p2->name.c_str());
+}
+
+bool Scheduler::is_finished()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	return all_scheduled() && retry.empty() && n_busy == 0;
+}
+
+// lock must be held; skips the games of an earlier run
+bool Scheduler::all_scheduled()
+{
+	if (pairings.empty())
+		return true;
+
+	if (dynamic)
+		return n_scheduled >= n_games;
+
+	while(next_nr < n_games && restored.find(next_nr) != restored.end()) {
+		next_nr++;
+
+		n_restored_ahead--;
+	}
+
+	return next_nr >= n_games;
+}
+
+void Scheduler::restore(const work_t & w)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	if (dynamic == false) {
+		if (restored.insert(w.nr).second && w.nr >= next_nr)
+			n_restored_ahead++;
+
+		update_metrics();
+
+		return;
+	}
+
+	pairing_t p = pairing_of(w);
+
+	n_played[p]++;
+
+	if (engines.at(p.first) == w.p1)
+		n_black_first[p]++;
+
+	n_scheduled++;
+
+	// the numbers of new games follow those of the earlier run
+	next_nr = std::max(next_nr, w.nr + 1);
+
+	update_metrics();
+}
+
+// lock must be held
+void Scheduler::update_metrics()
+{
+	int waiting = 0;
+
+	if (dynamic)
+		waiting = n_games - n_scheduled;
+	else
+		waiting = n_games - next_nr - n_restored_ahead;
+
+	n_waiting_metric = std::max(0, waiting) + int(retry.size());
+	n_busy_metric    = n_busy;
+}
@@ -0,0 +1,102 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "engine.h"
+
+
+typedef struct {
+	engine_parameters_t *p1, *p2;  // black, white
+	int nr;
+} work_t;
+
+// decides which engines play the next game. 'static' is the fixed round-robin
+// or gauntlet order; 'dynamic' picks, when a worker becomes free, the pairing
+// from which the ratings are expected to learn the most
+class Scheduler
+{
+private:
+	const std::vector<engine_parameters_t *> engines;
+	const bool dynamic;
+	const int  min_games;       // per pairing, before they are chosen on information
+	const bool colour_balance;  // alternate colours within a pairing (else random)
+
+	typedef std::pair<size_t, size_t> pairing_t;  // indexes in 'engines', first < second
+
+	std::vector<pairing_t> pairings;
+
+	// static
+	std::vector<work_t> order;
+
+	// dynamic, per pairing: games started, black games of 'first' and games in progress
+	std::map<pairing_t, int> n_played;
+	std::map<pairing_t, int> n_black_first;
+	std::map<pairing_t, int> n_in_flight;
+
+	int n_games { 0 };  // in total
+	int next_nr { 0 };
+
+	// static: game numbers that were played in an earlier run, and how many
+	// of them are at or after next_nr (for the metrics)
+	std::set<int> restored;
+	int           n_restored_ahead { 0 };
+	// dynamic: games handed out (or played in an earlier run)
+	int n_scheduled { 0 };
+
+	// games of workers that disconnected, these are handed out first
+	std::vector<work_t> retry;
+	int                 n_busy { 0 };
+
+	std::mutex              lock;
+	std::condition_variable cv;  // a game finished or was requeued
+
+	// copies for the metrics, so that they can be read without locking
+	std::atomic_int n_waiting_metric { 0 };
+	std::atomic_int n_busy_metric    { 0 };
+
+	double information(const pairing_t & p);
+	const pairing_t *choose();
+	work_t to_work(const pairing_t & p, const bool first_is_black, const int nr) const;
+	pairing_t pairing_of(const work_t & w) const;
+	std::optional<work_t> take();
+	bool all_scheduled();
+	void update_metrics();
+
+public:
+	Scheduler(const std::vector<engine_parameters_t *> & engines, const int iterations, const bool dynamic, const int min_games, const bool colour_balance);
+
+	int get_n_games() const { return n_games; }
+	// games that were not handed out yet, games in progress
+	int get_n_waiting() const { return n_waiting_metric; }
+	int get_n_busy() const { return n_busy_metric; }
+
+	// waits while no game can be handed out but some are still in progress
+	// (they may be requeued); nothing when all games were played or when
+	// stop_flag was set
+	std::optional<work_t> next(std::atomic_bool *const stop_flag);
+	// the same without waiting: nothing when no game can be handed out now,
+	// see is_finished() for if one may come
+	std::optional<work_t> try_next();
+	// what the next 'n' calls of next() would return now (for pre-warming),
+	// without scheduling them
+	std::vector<work_t> peek(const int n);
+	// a game that next() returned has finished
+	void done(const work_t & w);
+	// a game that next() returned could not be played (e.g. a worker
+	// disconnected), it is handed out again
+	void requeue(const work_t & w);
+	// all games were scheduled and none is in progress or waiting to be retried
+	bool is_finished();
+	// a game that was played in an earlier run (see Journal), before next() is used
+	void restore(const work_t & w);
+};
@@ -1,10 +1,13 @@
+#include <algorithm>
 #include <ctype.h>
 #include <dirent.h>
+#include <stdint.h>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include "color.h"
+#include "compress.h"
 #include "error.h"
 #include "sgf.h"
 
@@ -12,9 +15,10 @@
 // note that this code does not handle multiple roots
 bool load_sgf_opening(const std::string & file, book_entry_t *const be)
 {
-	FILE *fh = fopen(file.c_str(), "r");
+	// may be compressed
+	auto data = read_file(file);
 
-	if (!fh)
+	if (data.has_value() == false)
 		error_exit(true, "Cannot open %s", file.c_str());
 
 	be->moves.clear();
@@ -27,8 +31,8 @@ bool load_sgf_opening(const std::string & file, book_entry_t *const be)
 	std::string key;
 	std::string value;
 
-	while(!feof(fh) && !fail) {
-		int c = fgetc(fh);
+	for(size_t i=0; i<data.value().size() && !fail; i++) {
+		int c = (unsigned char)data.value().at(i);
 
 		if (c == '(') {
 			get_key = true;
@@ -90,8 +94,6 @@ bool load_sgf_opening(const std::string & file, book_entry_t *const be)
 		}
 	}
 
-	fclose(fh);
-
 	return !fail;
 }
 
@@ -101,26 +103,56 @@ bool load_sgf_opening_files(const std::string & path, std::vector<book_entry_t>
 	if (!dir)
 		error_exit(true, "Cannot open directory %s", path.c_str());
 
-	bool ok = true;
+	std::vector<std::string> files;
 
 	for(;;) {
 		dirent *entry = readdir(dir);
 		if (!entry)
 			break;
 
-		if (entry->d_type == DT_REG) {
-			book_entry_t be;
+		if (entry->d_type == DT_REG)
+			files.push_back(entry->d_name);
+	}
 
-			if (load_sgf_opening(path + "/" + entry->d_name, &be) == false) {
-				ok = false;
-				break;
-			}
+	closedir(dir);
 
-			entries->push_back(be);
-		}
+	// the order of readdir() differs per host, the openings are selected
+	// by index (also by the workers)
+	std::sort(files.begin(), files.end());
+
+	for(auto & file : files) {
+		book_entry_t be;
+
+		if (load_sgf_opening(path + "/" + file, &be) == false)
+			return false;
+
+		entries->push_back(be);
 	}
 
-	closedir(dir);
+	return true;
+}
+
+uint64_t book_checksum(const std::vector<book_entry_t> & entries)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;  // FNV-1a
+
+	auto add = [&hash](const int v) {
+		for(int i=0; i<4; i++) {
+			hash ^= (v >> (i * 8)) & 255;
+			hash *= 0x100000001b3ull;
+		}
+	};
+
+	for(auto & be : entries) {
+		add(be.dim);
+		add(be.moves.size());
+
+		for(auto & m : be.moves) {
+			add(std::get<0>(m));
+			add(std::get<1>(m));
+			add(std::get<2>(m));
+		}
+	}
 
-	return ok;
+	return hash;
 }
@@ -1,3 +1,4 @@
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -11,3 +12,6 @@ typedef struct {
 } book_entry_t;
 
 bool load_sgf_opening_files(const std::string & path, std::vector<book_entry_t> *const entries);
+
+// to verify that a worker has the same book (and order) as the coordinator
+uint64_t book_checksum(const std::vector<book_entry_t> & entries);
@@ -0,0 +1,174 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <cmath>
+#include <mutex>
+#include <string>
+
+#include "engine.h"
+#include "log.h"
+#include "sprt.h"
+
+
+static double elo_to_score(const double elo)
+{
+	return 1. / (1. + pow(10., -elo / 400.));
+}
+
+Sprt::Sprt(const engine_parameters_t *const test, const double elo0, const double elo1, const double alpha, const double beta) :
+	test(test),
+	elo0(elo0), elo1(elo1),
+	lower(log(beta / (1. - alpha))),
+	upper(log((1. - beta) / alpha))
+{
+	dolog(info, "SPRT for %s: elo0 %.2f, elo1 %.2f, alpha %.3f, beta %.3f, bounds [%.2f, %.2f]", test->name.c_str(), elo0, elo1, alpha, beta, lower, upper);
+}
+
+// the distribution with mean 's' that is closest (maximum likelihood) to the
+// observed frequencies 'p' of the scores 'a': p[i] / (1 + lambda * (a[i] - s))
+static void mle(const double *const p, const double *const a, const int n, const double s, double *const out)
+{
+	// keeps all probabilities positive
+	double lo = -1. / (a[n - 1] - s);
+	double hi =  1. / (s - a[0]);
+
+	// sum(p[i] * (a[i] - s) / (1 + lambda * (a[i] - s))) = 0 is decreasing in lambda
+	for(int it=0; it<100; it++) {
+		double lambda = (lo + hi) / 2.;
+		double f      = 0.;
+
+		for(int i=0; i<n; i++)
+			f += p[i] * (a[i] - s) / (1. + lambda * (a[i] - s));
+
+		if (f > 0.)
+			lo = lambda;
+		else
+			hi = lambda;
+	}
+
+	double lambda = (lo + hi) / 2.;
+
+	for(int i=0; i<n; i++)
+		out[i] = p[i] / (1. + lambda * (a[i] - s));
+}
+
+// log-likelihood ratio of the pair results under H1 versus H0
+double Sprt::llr()
+{
+	int n = 0;
+
+	for(int i=0; i<5; i++)
+		n += penta[i];
+
+	if (n == 0)
+		return 0.;
+
+	// regularized so that e.g. no losses at all does not give a degenerate distribution
+	double freq[5];
+	double total = 0.;
+
+	for(int i=0; i<5; i++) {
+		freq[i] = penta[i] + 1e-3;
+		total  += freq[i];
+	}
+
+	double scores[5];
+
+	for(int i=0; i<5; i++) {
+		freq  [i] /= total;
+		scores[i]  = i / 4.;
+	}
+
+	double p0[5], p1[5];
+
+	mle(freq, scores, 5, elo_to_score(elo0), p0);
+	mle(freq, scores, 5, elo_to_score(elo1), p1);
+
+	double out = 0.;
+
+	for(int i=0; i<5; i++)
+		out += freq[i] * log(p1[i] / p0[i]);
+
+	return n * out;
+}
+
+void Sprt::add(const int nr, const engine_parameters_t *const black, const std::string & result)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	std::optional<double> score;
+
+	char winner = tolower(result.at(0));
+
+	if (winner == 'b' || winner == 'w') {
+		bool black_won = winner == 'b';
+
+		score = black_won == (black == test) ? 1. : 0.;
+	}
+	else if (winner != '?') {
+		score = 0.5;
+	}
+
+	int  pair = nr / 2;
+	auto it   = half_pairs.find(pair);
+
+	if (it == half_pairs.end()) {
+		half_pairs.insert({ pair, score });
+
+		return;
+	}
+
+	auto other = it->second;
+	half_pairs.erase(it);
+
+	if (score.has_value() == false || other.has_value() == false) {
+		dolog(info, "SPRT: pair %d has a failed game, ignored", pair);
+
+		return;
+	}
+
+	penta[int((score.value() + other.value()) * 2)]++;
+
+	double cur = llr();
+
+	dolog(info, "SPRT: LLR %.3f [%.2f, %.2f], pairs (0-2 points) %d %d %d %d %d", cur, lower, upper, penta[0], penta[1], penta[2], penta[3], penta[4]);
+
+	if (decision.has_value())
+		return;
+
+	if (cur >= upper)
+		decision = true;
+	else if (cur <= lower)
+		decision = false;
+
+	if (decision.has_value())
+		dolog(notice, "SPRT: %s accepted, finishing the games in progress", decision.value() ? "H1" : "H0");
+}
+
+bool Sprt::is_decided()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	return decision.has_value();
+}
+
+void Sprt::log_summary()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	int    n      = 0;
+	double points = 0.;
+
+	for(int i=0; i<5; i++) {
+		n      += penta[i];
+		points += penta[i] * i / 2.;
+	}
+
+	double score = n ? points / (n * 2) : 0.5;
+
+	// +/- infinity for a 100% or 0% score
+	double elo   = -400. * log10(1. / score - 1.);
+
+	dolog(info, "SPRT: %d pairs, score %.1f%% (%.1f elo), LLR %.3f [%.2f, %.2f]: %s", n, score * 100., elo, llr(), lower, upper,
+			decision.has_value() ? (decision.value() ? "H1 accepted" : "H0 accepted") : "inconclusive");
+}
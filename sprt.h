@@ -0,0 +1,46 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "engine.h"
+
+
+// sequential probability ratio test: stops a match between two engines as
+// soon as it is clear that 'test' is (not) at least elo1 stronger than
+// elo0. Games nr 2n and 2n+1 are the same pairing with the colours reversed,
+// pairs are counted by their total score (pentanomial).
+class Sprt
+{
+private:
+	const engine_parameters_t *const test;
+	const double elo0, elo1;
+	const double lower, upper;  // log-likelihood ratio bounds
+
+	std::mutex lock;
+
+	// pair nr -> score of the first game to finish (for 'test')
+	std::map<int, std::optional<double> > half_pairs;
+
+	// pairs with 0, 0.5, 1, 1.5 and 2 points for 'test'
+	int penta[5] { 0 };
+
+	std::optional<bool> decision;  // true: H1 (elo1) accepted
+
+	double llr();
+
+public:
+	Sprt(const engine_parameters_t *const test, const double elo0, const double elo1, const double alpha, const double beta);
+
+	// 'result' as in play(), "?" for a failed game (the pair is then discarded)
+	void add(const int nr, const engine_parameters_t *const black, const std::string & result);
+
+	bool is_decided();
+
+	void log_summary();
+};
@@ -51,6 +51,76 @@ std::vector<std::string> split(std::string in, std::string splitter)
 	return out;
 }
 
+// unlike split(), empty fields are kept
+std::vector<std::string> split_fields(const std::string & in, const char separator)
+{
+	std::vector<std::string> out;
+	size_t start = 0;
+
+	for(;;) {
+		size_t pos = in.find(separator, start);
+
+		if (pos == std::string::npos) {
+			out.push_back(in.substr(start));
+
+			return out;
+		}
+
+		out.push_back(in.substr(start, pos - start));
+
+		start = pos + 1;
+	}
+}
+
+// splits a command line like a shell would: whitespace separates the
+// arguments, quotes and backslashes can be used to include whitespace
+std::vector<std::string> split_command(const std::string & in)
+{
+	std::vector<std::string> out;
+	std::string              cur;
+	bool                     has_cur = false;
+	char                     quote   = 0;
+
+	for(size_t i=0; i<in.size(); i++) {
+		char c = in.at(i);
+
+		if (quote == '\'') {
+			if (c == '\'')
+				quote = 0;
+			else
+				cur += c;
+		}
+		else if (c == '\\' && i + 1 < in.size() && (quote == 0 || in.at(i + 1) == '"' || in.at(i + 1) == '\\')) {
+			cur += in.at(++i);
+		}
+		else if (quote == '"') {
+			if (c == '"')
+				quote = 0;
+			else
+				cur += c;
+		}
+		else if (c == '\'' || c == '"') {
+			quote   = c;
+			has_cur = true;
+		}
+		else if (c == ' ' || c == '\t') {
+			if (has_cur || cur.empty() == false)
+				out.push_back(cur);
+
+			cur.clear();
+			has_cur = false;
+		}
+		else {
+			cur += c;
+		}
+	}
+
+	if (has_cur || cur.empty() == false)
+		out.push_back(cur);
+
+	return out;
+}
+
 std::string str_tolower(std::string s)
 {
 	std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c){ return std::tolower(c); });
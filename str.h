@@ -9,6 +9,8 @@
 std::string myformat(const char *const fmt, ...);
 
 std::vector<std::string> split(std::string in, std::string splitter);
+std::vector<std::string> split_fields(const std::string & in, const char separator);
+std::vector<std::string> split_command(const std::string & in);
 std::string merge(const std::vector<std::string> & in, const std::string & seperator);
 
 std::string str_tolower(std::string s);
@@ -0,0 +1,214 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <stdio.h>
+#include <string>
+
+#include "../board.h"
+#include "../color.h"
+
+
+static int n_failed = 0;
+
+#define CHECK(x) do { if (!(x)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #x); n_failed++; } } while(0)
+
+static void test_capture()
+{
+	Board<9> b;
+
+	CHECK(b.play(C_WHITE, 4, 4));
+	CHECK(b.play(C_BLACK, 3, 4));
+	CHECK(b.play(C_BLACK, 5, 4));
+	CHECK(b.play(C_BLACK, 4, 3));
+	CHECK(b.score() == 3 - 1);
+
+	// takes the last liberty: only black stones are left
+	CHECK(b.play(C_BLACK, 4, 5));
+	CHECK(b.score() == 81);
+
+	// suicide
+	CHECK(b.play(C_WHITE, 4, 4) == false);
+	CHECK(b.score() == 81);
+
+	// occupied, outside of the board
+	CHECK(b.play(C_WHITE, 3, 4) == false);
+	CHECK(b.play(C_WHITE, 9, 0) == false);
+	CHECK(b.play(C_WHITE, 0, -1) == false);
+}
+
+// Board<> hides the GTP vertex version of play()
+static bool play(GoBoard & b, const color_t c, const std::string & vertex)
+{
+	return b.play(c, vertex);
+}
+
+static void test_vertex()
+{
+	Board<9> b;
+
+	// there's no 'i' in GTP coordinates
+	CHECK(play(b, C_BLACK, "I5") == false);
+	CHECK(play(b, C_BLACK, "J9"));
+	CHECK(b.play(C_BLACK, 8, 8) == false);
+	CHECK(play(b, C_WHITE, "a1"));
+	CHECK(b.play(C_WHITE, 0, 0) == false);
+	CHECK(play(b, C_WHITE, "pass"));
+	CHECK(play(b, C_WHITE, "Z1") == false);
+	CHECK(play(b, C_WHITE, "x") == false);
+}
+
+// . B W .
+// B L R W    L, R: the ko points, B takes the ko on R, W on L
+// . B W .
+static void ko_frame(GoBoard *const b, const int row)
+{
+	CHECK(b->play(C_BLACK, 1, row));
+	CHECK(b->play(C_BLACK, 0, row + 1));
+	CHECK(b->play(C_BLACK, 1, row + 2));
+	CHECK(b->play(C_WHITE, 2, row));
+	CHECK(b->play(C_WHITE, 3, row + 1));
+	CHECK(b->play(C_WHITE, 2, row + 2));
+}
+
+static void test_ko()
+{
+	Board<9> b;
+
+	ko_frame(&b, 0);
+
+	CHECK(b.play(C_WHITE, 1, 1));
+	CHECK(b.play(C_BLACK, 2, 1));  // captures
+
+	Board<9> probe = b;
+	CHECK(probe.play(C_BLACK, 1, 1));  // empty again
+
+	// re-taking right away repeats the position
+	int before = b.score();
+	CHECK(b.play(C_WHITE, 1, 1) == false);
+	CHECK(b.score() == before);
+
+	// after a move elsewhere it can be taken back
+	CHECK(b.play(C_WHITE, 8, 8));
+	CHECK(b.play(C_BLACK, 7, 8));
+	CHECK(b.play(C_WHITE, 1, 1));
+
+	probe = b;
+	CHECK(probe.play(C_WHITE, 2, 1));  // the black stone was captured
+}
+
+// three kos: a cycle of 6 captures in which no capture is an immediate
+// re-take, only positional superko stops it
+static void test_superko()
+{
+	Board<9> b;
+
+	for(int row : { 0, 3, 6 })
+		ko_frame(&b, row);
+
+	// black holds the first two kos, white the third
+	CHECK(b.play(C_BLACK, 2, 1));
+	CHECK(b.play(C_BLACK, 2, 4));
+	CHECK(b.play(C_WHITE, 1, 7));
+
+	CHECK(b.play(C_WHITE, 1, 1));
+	CHECK(b.play(C_BLACK, 2, 1) == false);  // simple ko
+	CHECK(b.play(C_BLACK, 2, 7));
+	CHECK(b.play(C_WHITE, 1, 4));
+	CHECK(b.play(C_BLACK, 2, 1));
+	CHECK(b.play(C_WHITE, 1, 7));
+
+	// would be the starting position again
+	int before = b.score();
+	CHECK(b.play(C_BLACK, 2, 4) == false);
+
+	// the board was not changed by the rejected move
+	CHECK(b.score() == before);
+
+	Board<9> probe = b;
+	CHECK(probe.play(C_WHITE, 2, 4));  // still empty
+
+	// and after clear() nothing is remembered
+	b.clear();
+
+	CHECK(b.score() == 0);
+
+	for(int row : { 0, 3, 6 })
+		ko_frame(&b, row);
+
+	CHECK(b.play(C_BLACK, 2, 4));
+}
+
+static void test_score()
+{
+	Board<9> b;
+
+	// empty board: nobody owns anything
+	CHECK(b.score() == 0);
+	CHECK(b.result(7.5) == "W+7.5");
+	CHECK(b.result(-0.5) == "B+0.5");
+	CHECK(b.result(0) == "0");
+
+	// a black wall on column 3, a white one on column 6: columns 4 and 5
+	// border both (like the shared liberties of a seki) and count for neither
+	for(int y=0; y<9; y++) {
+		CHECK(b.play(C_BLACK, 3, y));
+		CHECK(b.play(C_WHITE, 6, y));
+	}
+
+	CHECK(b.score() == 36 - 27);
+	CHECK(b.result(7.5) == "B+1.5");
+	CHECK(b.result(9) == "0");
+
+	// tromp/taylor: a (dead) white stone in black's area is not removed, the
+	// area then borders both colours
+	CHECK(b.play(C_WHITE, 0, 0));
+	CHECK(b.score() == 9 - 28);
+}
+
+static void test_seki()
+{
+	Board<9> b;
+
+	//   3  O O O O O O
+	//   2  X X X X X O   the inner black (X) and white (O) groups share
+	//   1  . O O . X O   the liberties A1 and D1: whoever plays on one of
+	//      A B C D E F   them is captured
+	for(auto v : { "A2", "B2", "C2", "D2", "E2", "E1" })
+		CHECK(play(b, C_BLACK, v));
+
+	for(auto v : { "B1", "C1", "A3", "B3", "C3", "D3", "E3", "F3", "F2", "F1" })
+		CHECK(play(b, C_WHITE, v));
+
+	// the shared liberties count for neither, the rest is white's area
+	CHECK(b.score() == 6 - (81 - 6 - 2));
+
+	Board<9> black_tries = b;
+	CHECK(play(black_tries, C_BLACK, "A1"));
+	CHECK(play(black_tries, C_WHITE, "D1"));  // captures the 7 black stones
+	CHECK(black_tries.score() == -81);
+
+	Board<9> white_tries = b;
+	CHECK(play(white_tries, C_WHITE, "D1"));
+	CHECK(play(white_tries, C_BLACK, "A1"));  // captures B1, C1 and D1
+	CHECK(white_tries.score() == 7 + 3 - (8 + 63));
+}
+
+int main(int argc, char *argv[])
+{
+	test_capture();
+	test_vertex();
+	test_ko();
+	test_superko();
+	test_score();
+	test_seki();
+
+	if (n_failed) {
+		printf("%d check(s) failed\n", n_failed);
+
+		return 1;
+	}
+
+	printf("all board tests passed\n");
+
+	return 0;
+}
@@ -0,0 +1,125 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <cmath>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "../engine.h"
+#include "../ratings.h"
+
+
+static int n_failed = 0;
+
+#define CHECK(x) do { if (!(x)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #x); n_failed++; } } while(0)
+
+static void add(Ratings *const r, const engine_parameters_t *const black, const engine_parameters_t *const white, const int n, const std::string & result)
+{
+	for(int i=0; i<n; i++)
+		r->add(black, white, result);
+}
+
+static double elo_of(const std::vector<elo_rating_t> & ratings, const engine_parameters_t *const e)
+{
+	for(auto & rating : ratings) {
+		if (rating.engine == e)
+			return rating.elo;
+	}
+
+	return NAN;
+}
+
+// every engine scores the same against every other, with both colours
+static void test_symmetric()
+{
+	engine_parameters_t a, b, c;
+	std::vector<engine_parameters_t *> engines { &a, &b, &c };
+
+	Ratings r(engines, 2., 1, 0);
+
+	CHECK(r.update() == false);  // no games
+
+	for(auto black : engines) {
+		for(auto white : engines) {
+			if (black == white)
+				continue;
+
+			add(&r, black, white, 7, "B+Resign");
+			add(&r, black, white, 9, "W+3.5");
+			add(&r, black, white, 2, "0");
+		}
+	}
+
+	// ignored
+	add(&r, &a, &b, 5, "?");
+
+	CHECK(r.update());
+
+	auto ratings = r.get_ratings();
+
+	CHECK(ratings.size() == 3);
+
+	for(auto & rating : ratings) {
+		CHECK(fabs(rating.elo) < 1e-6);
+		CHECK(rating.error > 0.);
+	}
+}
+
+// two engines, no draws: the model has as many parameters (the difference
+// and the advantage of white) as there are independent results, so every
+// maximum likelihood solver ends up at 400 * log10 of the odds. That is
+// also what BayesElo (prior 0, draw elo 0) reports for these games:
+// +38 and -38, with an advantage of 89 for white.
+static void test_bayeselo()
+{
+	engine_parameters_t a, b;
+	std::vector<engine_parameters_t *> engines { &a, &b };
+
+	Ratings r(engines, 0., 1, 0);
+
+	// a wins 36 of 50 with white, 24 of 50 with black
+	add(&r, &b, &a, 36, "W+Resign");
+	add(&r, &b, &a, 14, "B+Resign");
+	add(&r, &a, &b, 24, "B+Resign");
+	add(&r, &a, &b, 26, "W+Resign");
+
+	CHECK(r.update());
+
+	auto logit = [](const double p) { return log10(p / (1. - p)) * 400.; };
+
+	double diff = (logit(36. / 50.) - logit(26. / 50.)) / 2.;  // 75.08
+
+	auto ratings = r.get_ratings();
+
+	CHECK(fabs(elo_of(ratings, &a) - diff / 2.) < 0.01);
+	CHECK(fabs(elo_of(ratings, &b) + diff / 2.) < 0.01);
+
+	// the same result from a different order of the games
+	Ratings r2(engines, 0., 1, 0);
+
+	for(int i=0; i<50; i++) {
+		add(&r2, &a, &b, 1, i < 24 ? "B+R" : "W+R");
+		add(&r2, &b, &a, 1, i < 36 ? "W+R" : "B+R");
+	}
+
+	CHECK(r2.update());
+
+	CHECK(fabs(elo_of(r2.get_ratings(), &a) - diff / 2.) < 0.01);
+}
+
+int main(int argc, char *argv[])
+{
+	test_symmetric();
+	test_bayeselo();
+
+	if (n_failed) {
+		printf("%d check(s) failed\n", n_failed);
+
+		return 1;
+	}
+
+	printf("all ratings tests passed\n");
+
+	return 0;
+}
@@ -19,6 +19,17 @@ uint64_t get_ts_ms()
 	return uint64_t(ts.tv_sec) * uint64_t(1000) + uint64_t(ts.tv_nsec / 1000000);
 }
 
+// for measuring durations: not affected by changes of the system clock
+uint64_t get_ts_ns()
+{
+	struct timespec ts { 0, 0 };
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		error_exit(true, "clock_gettime failed");
+
+	return uint64_t(ts.tv_sec) * uint64_t(1000000000) + uint64_t(ts.tv_nsec);
+}
+
 void mymsleep(uint64_t ms)
 {
         struct timespec req;
@@ -4,5 +4,6 @@
 #include <stdint.h>
 
 uint64_t get_ts_ms();
+uint64_t get_ts_ns();
 
 void mymsleep(uint64_t ms);
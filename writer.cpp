@@ -0,0 +1,213 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "archive.h"
+#include "compress.h"
+#include "error.h"
+#include "journal.h"
+#include "log.h"
+#include "str.h"
+#include "time.h"
+#include "writer.h"
+
+
+static int open_append(const std::string & file)
+{
+	if (file.empty())
+		return -1;
+
+	int fd = open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1)
+		error_exit(true, "Cannot open \"%s\"", file.c_str());
+
+	return fd;
+}
+
+static bool write_all(const int fd, const std::string & data)
+{
+	const char *p   = data.c_str();
+	size_t      len = data.size();
+
+	while(len > 0) {
+		ssize_t rc = write(fd, p, len);
+
+		if (rc == -1 && errno == EINTR)
+			continue;
+
+		if (rc <= 0)
+			return false;
+
+		p   += rc;
+		len -= rc;
+	}
+
+	return true;
+}
+
+ResultWriter::ResultWriter(const std::string & pgn_file, const std::string & sgf_file, const std::string & sgf_dir, const int flush_interval_ms, const int fsync_interval_ms, const std::string & archive_file, Journal *const journal) :
+	pgn_file(pgn_file), sgf_file(sgf_file),
+	sgf_dir(sgf_dir),
+	flush_interval_ms(flush_interval_ms),
+	fsync_interval_ms(fsync_interval_ms),
+	journal(journal),
+	q(65536)
+{
+	pgn_fd = open_append(pgn_file);
+	sgf_fd = open_append(sgf_file);
+
+	pgn_ct = compression_of(pgn_file);
+	sgf_ct = compression_of(sgf_file);
+
+	if (sgf_dir.empty() == false && mkdir(sgf_dir.c_str(), 0755) == -1 && errno != EEXIST)
+		error_exit(true, "Cannot create directory \"%s\"", sgf_dir.c_str());
+
+	if (archive_file.empty() == false)
+		archive = new ArchiveWriter(archive_file);
+
+	last_fsync = get_ts_ms();
+
+	th = new std::thread(&ResultWriter::run, this);
+}
+
+ResultWriter::~ResultWriter()
+{
+	q.close();
+
+	th->join();
+	delete th;
+
+	if (pgn_fd != -1) {
+		fsync(pgn_fd);
+		close(pgn_fd);
+	}
+
+	if (sgf_fd != -1) {
+		fsync(sgf_fd);
+		close(sgf_fd);
+	}
+
+	// also writes the index of the archive
+	delete archive;
+
+	dolog(info, "Result writer: %" PRIu64 " games in %" PRIu64 " writes, at most %zu games were waiting", n_records, n_batches, q.get_max_depth());
+}
+
+void ResultWriter::add(game_record_t *const r)
+{
+	// only waits when the writer is tens of thousands of games behind
+	if (q.push(r) == false) {
+		dolog(error, "Result of game %d added after the writer was stopped", r->nr);
+
+		delete r;
+	}
+}
+
+void ResultWriter::run()
+{
+	for(;;) {
+		auto r = q.pop();
+
+		if (r.has_value() == false)  // closed and empty
+			break;
+
+		std::vector<game_record_t *> batch { r.value() };
+
+		uint64_t deadline = get_ts_ms() + flush_interval_ms;
+
+		for(;;) {
+			uint64_t now = get_ts_ms();
+
+			r = now < deadline ? q.pop(int(deadline - now)) : q.try_pop();
+
+			if (r.has_value() == false)
+				break;
+
+			batch.push_back(r.value());
+		}
+
+		write_batch(batch);
+	}
+}
+
+// sgf_dir/123/123456.sgf: at most 1000 files per directory
+void ResultWriter::write_game_sgf(const game_record_t *const r)
+{
+	std::string dir = myformat("%s/%03d", sgf_dir.c_str(), r->nr / 1000);
+
+	if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+		dolog(error, "Cannot create directory \"%s\": %s", dir.c_str(), strerror(errno));
+
+		return;
+	}
+
+	std::string file = myformat("%s/%d.sgf", dir.c_str(), r->nr);
+
+	int fd = open(file.c_str(), O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC, 0644);
+
+	if (fd == -1 || write_all(fd, r->sgf) == false)
+		dolog(error, "Cannot write \"%s\": %s", file.c_str(), strerror(errno));
+
+	if (fd != -1)
+		close(fd);
+}
+
+void ResultWriter::write_batch(const std::vector<game_record_t *> & batch)
+{
+	std::string pgn;
+	std::string sgf;
+
+	for(auto & r : batch) {
+		pgn += r->pgn;
+		sgf += r->sgf;
+
+		if (sgf_dir.empty() == false && r->sgf.empty() == false)
+			write_game_sgf(r);
+
+		if (archive && r->archive.has_value())
+			archive->add(r->archive.value());
+	}
+
+	// a compressed batch is a gzip member or zstd frame of its own
+	if (pgn_fd != -1 && pgn.empty() == false && write_all(pgn_fd, compress_block(pgn_ct, pgn)) == false)
+		dolog(error, "Cannot write to \"%s\": %s", pgn_file.c_str(), strerror(errno));
+
+	if (sgf_fd != -1 && sgf.empty() == false && write_all(sgf_fd, compress_block(sgf_ct, sgf)) == false)
+		dolog(error, "Cannot write to \"%s\": %s", sgf_file.c_str(), strerror(errno));
+
+	if (archive)
+		archive->flush();
+
+	uint64_t now = get_ts_ms();
+
+	if (fsync_interval_ms > 0 && now - last_fsync >= uint64_t(fsync_interval_ms)) {
+		if (pgn_fd != -1)
+			fsync(pgn_fd);
+
+		if (sgf_fd != -1)
+			fsync(sgf_fd);
+
+		last_fsync = now;
+	}
+
+	// after the pgn/sgf files: a game that is in the journal is not played again
+	for(auto & r : batch) {
+		if (journal && r->journal_entry.has_value())
+			journal->add(r->journal_entry.value());
+
+		delete r;
+	}
+
+	n_records += batch.size();
+	n_batches++;
+}
@@ -0,0 +1,68 @@
+// (C) 2021-2023 by Folkert van Heusden <mail@vanheusden.com>
+// Released under MIT license
+
+#pragma once
+
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "archive.h"
+#include "compress.h"
+#include "journal.h"
+#include "queue.h"
+
+
+typedef struct {
+	int                             nr;
+	std::string                     pgn;  // empty: not for the pgn file (e.g. a failed game)
+	std::string                     sgf;  // empty: no sgf
+	std::optional<journal_entry_t>  journal_entry;
+	std::optional<archive_record_t> archive;
+} game_record_t;
+
+// writes the pgn/sgf files, the archive and the journal from a thread of its
+// own, so that the threads that play the games do not wait for the disk. The
+// files are kept open, records that are waiting are written together.
+class ResultWriter
+{
+private:
+	const std::string pgn_file, sgf_file;
+	const std::string sgf_dir;            // one file per game in here, when set
+	const int         flush_interval_ms;  // a record may wait this long for others
+	const int         fsync_interval_ms;  // 0: never
+	Journal *const    journal;
+	ArchiveWriter    *archive { nullptr };
+
+	int pgn_fd { -1 };
+	int sgf_fd { -1 };
+
+	compression_t pgn_ct { CT_NONE };  // from the file names
+	compression_t sgf_ct { CT_NONE };
+
+	Queue<game_record_t *> q;
+	std::thread           *th { nullptr };
+
+	uint64_t last_fsync { 0 };
+	uint64_t n_records  { 0 };
+	uint64_t n_batches  { 0 };
+
+	void run();
+	void write_batch(const std::vector<game_record_t *> & batch);
+	void write_game_sgf(const game_record_t *const r);
+
+public:
+	ResultWriter(const std::string & pgn_file, const std::string & sgf_file, const std::string & sgf_dir, const int flush_interval_ms, const int fsync_interval_ms, const std::string & archive_file, Journal *const journal);
+	// writes everything that was added
+	~ResultWriter();
+
+	bool has_archive() const { return archive != nullptr; }
+
+	// records that were not written yet
+	size_t get_queue_depth() const { return q.depth(); }
+
+	// takes ownership of 'r'
+	void add(game_record_t *const r);
+};